@@ -20,6 +20,10 @@ public:
 
     GeometryPtr geom_ ;
     Pose pose_ ;
+
+    // Collision filtering is done per body so the shapes of a body are merged: the body belongs to the groups of all its
+    // shapes and collides only with groups accepted by the masks of all its shapes.
+    int collision_group_ = 0, collision_mask_ = -1 ;
 };
 
 }
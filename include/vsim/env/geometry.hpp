@@ -46,6 +46,24 @@ struct ConeGeometry: public Geometry {
     float radius_, height_ ;
 };
 
+// Terrain given as a regular grid of heights. The grid is centered on the origin of the x-z plane and heights are along the y-axis.
+// Heightfields may only be used by static bodies (zero mass).
+
+struct HeightfieldGeometry: public Geometry {
+    size_t n_cols_ = 0, n_rows_ = 0 ;   // number of samples along x and z
+    Eigen::Vector2f size_ = { 1, 1 } ;  // extent of the grid along x and z
+    std::vector<float> heights_ ;       // n_rows_ x n_cols_ samples in row major order, rows are along z
+    float min_height_ = 0, max_height_ = 0 ;
+
+    // Load heights from a grayscale image (preferably 16-bit) mapping pixel values linearly to [0, max_height].
+    // The top row of the image is at -z. Throws std::runtime_error if the image cannot be loaded.
+    void load(const std::string &fpath, float max_height) ;
+
+    float height(size_t row, size_t col) const { return heights_[row * n_cols_ + col] ; }
+};
+
+typedef std::shared_ptr<HeightfieldGeometry> HeightfieldGeometryPtr ;
+
 
 static const int MAX_MESH_TEXTURES = 4 ;
 
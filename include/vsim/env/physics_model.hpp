@@ -22,6 +22,8 @@ public:
 
     std::vector<RigidBodyPtr> bodies_ ;
     std::vector<RigidBodyConstraintPtr> constraints_ ;
+
+    bool self_collisions_ = true ; // if false bodies of the model never collide with each other
 };
 
 }
@@ -21,6 +21,7 @@ public:
 
     std::vector<RigidBodyPtr> bodies_ ;
     std::vector<PhysicsModelPtr> models_ ;
+    std::vector<RigidBodyConstraintPtr> constraints_ ; // constraints between bodies of different models
 };
 
 }
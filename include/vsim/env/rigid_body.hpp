@@ -23,13 +23,26 @@ public:
 
     RigidBody() = default ;
 
+    bool isStatic() const { return mass_ <= 0 ; }
+
 public:
 
+    // shapes placed at their pose in the body frame, several shapes are merged into a single compound shape
     std::vector<CollisionShapePtr> shapes_ ;
 
     Pose pose_ ;
-    float mass_ ;
-    Eigen::Vector3f velocity_, angular_velocity_ ;
+    float mass_ = 0 ;  // zero mass bodies are static, negative masses are rejected by the physics
+
+    // Continuous collision detection of dynamic bodies. Once the body moves more than the motion threshold in a step it is
+    // swept as a sphere of the given radius centered on the body origin to prevent tunneling. Negative values are derived
+    // from the depth of the origin in the collision shape containing it (none if the origin lies outside all shapes), a
+    // zero threshold disables it for this body.
+    float ccd_swept_sphere_radius_ = -1, ccd_motion_threshold_ = -1 ;
+
+    // Two bodies collide if the group of each one intersects the mask of the other. Group zero is the default group of the
+    // body (static or dynamic, static bodies never collide with each other). See also CollisionShape.
+    int collision_group_ = 0, collision_mask_ = -1 ;
+    Eigen::Vector3f velocity_ = Eigen::Vector3f::Zero(), angular_velocity_ = Eigen::Vector3f::Zero() ;
 
     NodePtr visual_ ;
 };
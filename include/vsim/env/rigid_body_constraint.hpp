@@ -19,6 +19,7 @@ class RigidBodyConstraint: public BaseElement {
 public:
 
     RigidBodyConstraint() = default ;
+    virtual ~RigidBodyConstraint() {}
 
 public:
 
@@ -26,8 +27,11 @@ public:
 };
 
 struct HingeConstraint: public RigidBodyConstraint {
-    HingeConstraint() ;
+    HingeConstraint(): pivot_a_(0, 0, 0), pivot_b_(0, 0, 0), axis_a_(0, 0, 1), axis_b_(0, 0, 1),
+        min_angle_(-M_PI), max_angle_(M_PI) {}
 
+    Eigen::Vector3f pivot_a_, pivot_b_ ; // pivot point expressed in the local frame of each body
+    Eigen::Vector3f axis_a_, axis_b_ ;   // hinge axis expressed in the local frame of each body
     float min_angle_, max_angle_ ;
 };
 
@@ -20,6 +20,9 @@ typedef std::shared_ptr<SkinningModifier> SkinningModifierPtr ;
 struct Geometry ;
 typedef std::shared_ptr<Geometry> GeometryPtr ;
 
+struct HeightfieldGeometry ;
+typedef std::shared_ptr<HeightfieldGeometry> HeightfieldGeometryPtr ;
+
 struct Bone ;
 typedef std::shared_ptr<Bone> BonePtr ;
 
@@ -0,0 +1,56 @@
+#ifndef __VSIM_PHYSICS_COLLISION_CHECKER_HPP__
+#define __VSIM_PHYSICS_COLLISION_CHECKER_HPP__
+
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include <vsim/physics/world.hpp>
+#include <vsim/util/thread_pool.hpp>
+
+namespace vsim { namespace physics {
+
+class ShapeLibrary ;
+
+// Collision queries for many configurations of a model, e.g. for motion planning. The bodies of the model are placed at the
+// given poses while all other bodies of the scene are fixed obstacles at their scene pose. Nothing is simulated and the scene
+// is only read on construction. Each thread of the pool owns a collision world with its own broadphase and narrowphase state.
+
+class CollisionChecker {
+public:
+
+    static const size_t POSE_SIZE = 7 ; // position (x, y, z), orientation quaternion (x, y, z, w)
+
+    // The model should be part of the scene. Pairs of model bodies linked by a constraint are never checked, nor are pairs
+    // excluded by the collision groups and masks of the bodies or by disabled self collisions of the model.
+    // Queries run on the process wide thread pool unless n_threads is not zero, in which case the checker gets a pool of its
+    // own of that size.
+    CollisionChecker(const PhysicsScenePtr &scene, const PhysicsModelPtr &model, const WorldConfig &config = WorldConfig(), size_t n_threads = 0) ;
+    ~CollisionChecker() ;
+
+    // number of model bodies
+    size_t numBodies() const { return n_bodies_ ; }
+
+    // Check n configurations, each given by numBodies() * POSE_SIZE values in the order of the model bodies. out_collisions[i]
+    // is set to 1 if configuration i is in collision and 0 otherwise. Checking of a configuration stops at the first contact
+    // unless out_distances is given; it then receives the minimum signed distance between model bodies and obstacles or
+    // between model bodies, clamped to max_distance.
+    void check(size_t n, const float *poses, uint8_t *out_collisions, float *out_distances = nullptr, float max_distance = 0.1f) ;
+
+private:
+
+    struct Context ;
+
+    std::shared_ptr<ShapeLibrary> shapes_ ;
+    std::vector<std::unique_ptr<Context>> contexts_ ;
+    std::vector<bool> linked_ ;  // n_bodies_ x n_bodies_ matrix of pairs linked by constraints
+    size_t n_bodies_ ;
+    std::unique_ptr<util::ThreadPool> own_pool_ ;
+    util::ThreadPool &pool_ ;
+    std::mutex mutex_ ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __VSIM_PHYSICS_CONTACT_STREAM_HPP__
+#define __VSIM_PHYSICS_CONTACT_STREAM_HPP__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <Eigen/Core>
+
+namespace vsim { namespace physics {
+
+// Contact between a pair of bodies at the end of an internal step. All contact points between the two bodies are merged into a single event.
+
+struct ContactEvent {
+
+    enum Type : uint8_t { BEGIN, PERSIST, END } ;
+
+    static const size_t MAX_POINTS = 4 ;
+
+    struct Point {
+        Eigen::Vector3f position_ ; // world space point on the surface of body_b_
+        Eigen::Vector3f normal_ ;   // world space normal pointing from body_b_ towards body_a_
+        float distance_ ;           // negative when penetrating
+        float impulse_ ;            // normal impulse applied by the solver
+    };
+
+    Type type_ ;
+    float time_ ;             // simulation time at the end of the internal step
+    int body_a_, body_b_ ;    // body indices as in World::body(), body_a_ < body_b_
+    float impulse_ ;          // total normal impulse over all contact points of the pair
+    uint32_t n_points_ ;      // points stored below (up to MAX_POINTS), zero for END events
+    Point points_[MAX_POINTS] ;
+};
+
+// Selection of the contacts that are reported. A pair is reported if any of its bodies is selected by id or belongs to a
+// selected model; all bodies are selected if both lists are empty. Pairs whose total impulse is below min_impulse_ are
+// considered not in contact.
+
+struct ContactFilter {
+    std::vector<std::string> bodies_ ;   // ids of bodies
+    std::vector<std::string> models_ ;   // ids of physics models
+    float min_impulse_ = 0 ;
+    bool transitions_only_ = false ;     // emit only BEGIN and END events
+};
+
+// Fixed capacity ring buffer of contact events filled by World after each internal step. When full the oldest events are overwritten.
+
+class ContactStream {
+public:
+
+    ContactStream(size_t capacity) ;
+
+    size_t capacity() const { return buffer_.size() ; }
+    size_t size() const { return size_ ; }
+    bool empty() const { return size_ == 0 ; }
+
+    // number of events overwritten before they were read
+    size_t numDropped() const { return n_dropped_ ; }
+
+    // remove the oldest event, returns false if the stream is empty
+    bool pop(ContactEvent &event) ;
+
+    // move up to max_events of the oldest events to the given array and return their number
+    size_t read(ContactEvent *events, size_t max_events) ;
+
+    void clear() ;
+
+    void push(const ContactEvent &event) ;
+
+private:
+
+    std::vector<ContactEvent> buffer_ ;
+    size_t head_ = 0, size_ = 0, n_dropped_ = 0 ;
+} ;
+
+}}
+
+#endif
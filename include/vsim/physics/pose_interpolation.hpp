@@ -0,0 +1,46 @@
+#ifndef __VSIM_PHYSICS_POSE_INTERPOLATION_HPP__
+#define __VSIM_PHYSICS_POSE_INTERPOLATION_HPP__
+
+#include <cstddef>
+
+namespace vsim { namespace physics {
+
+// Interpolation of body poses between two physics states, used to render at a rate different from the physics rate. The poses
+// of n bodies are stored as a structure of POSE_SIZE arrays of n values as written by World::getPoses(): the x coordinates of
+// all positions followed by the y and z coordinates, then the x, y, z and w components of all orientations.
+
+static const size_t POSE_SIZE = 7 ; // position (x, y, z), orientation quaternion (x, y, z, w)
+
+// Write the poses at fraction t in [0, 1] between from and to for n bodies: positions are interpolated linearly and
+// orientations along the shortest arc by a normalized linear interpolation with a polynomial correction of t that follows
+// spherical interpolation within 3e-4. out may not overlap the inputs.
+void interpolatePoses(size_t n, const float *from, const float *to, float t, float *out) ;
+
+// Fixed time step accumulator. Frames of any duration are added with advance() which returns the number of physics steps
+// to take; the remaining fraction of a step (alpha()) is the interpolation parameter between the last two physics states.
+
+class StepAccumulator {
+public:
+
+    // frames longer than max_frame_time are truncated so that a stall does not trigger a burst of catch up steps
+    StepAccumulator(float time_step, float max_frame_time = 0.25f): time_step_(time_step), max_frame_time_(max_frame_time) {}
+
+    size_t advance(float frame_time) {
+        accumulator_ += frame_time < max_frame_time_ ? frame_time : max_frame_time_ ;
+        size_t n = static_cast<size_t>(accumulator_ / time_step_) ;
+        accumulator_ -= n * time_step_ ;
+        return n ;
+    }
+
+    float alpha() const { return accumulator_ / time_step_ ; }
+    float timeStep() const { return time_step_ ; }
+
+private:
+
+    float time_step_, max_frame_time_ ;
+    float accumulator_ = 0 ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __VSIM_PHYSICS_PROFILER_HPP__
+#define __VSIM_PHYSICS_PROFILER_HPP__
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+namespace vsim { namespace physics {
+
+// Timings and workload of a single call to World::step. Times are wall clock seconds summed over all internal steps.
+// The phases are timed through the profiling zones of Bullet, they are zero if Bullet was built with BT_NO_PROFILE.
+
+struct StepProfile {
+    float time_ ;                   // simulation time at the end of the step
+    double total_ ;                 // whole step including the phases below
+    double broadphase_ ;            // bounding box updates and overlapping pair search
+    double narrowphase_ ;           // contact generation for the overlapping pairs
+    double solver_ ;                // contact and joint constraints
+    double integration_ ;           // velocity prediction and integration of transforms
+    double sync_ ;                  // write back to the scene and contact events
+    uint32_t n_sub_steps_ ;
+    uint32_t n_pairs_ ;             // overlapping pairs of the broadphase after the last internal step
+    uint32_t n_manifolds_ ;         // contact manifolds after the last internal step
+    uint32_t n_contacts_ ;          // contact points over all manifolds
+    uint32_t n_solver_iterations_ ; // iterations of the solver per internal step (as configured)
+};
+
+// Fixed capacity history of step profiles filled by World after each step, the oldest profiles are overwritten when full.
+// Profiling reads the clock a few dozen times per step so it may be left on in production runs.
+
+class StepProfiler {
+public:
+
+    StepProfiler(size_t capacity) ;
+
+    size_t capacity() const { return buffer_.size() ; }
+    size_t size() const { return size_ ; }
+    bool empty() const { return size_ == 0 ; }
+
+    // i-th profile from the oldest one kept
+    const StepProfile &operator[](size_t i) const { return buffer_[( head_ + i ) % buffer_.size()] ; }
+
+    // profile of the last step, the profiler should not be empty
+    const StepProfile &last() const { return (*this)[size_ - 1] ; }
+
+    // mean of all kept profiles
+    StepProfile average() const ;
+
+    void clear() ;
+
+    // write the kept profiles as comma separated values with a header line, times in milliseconds
+    void writeCSV(std::ostream &strm) const ;
+    void writeCSV(const std::string &fname) const ;
+
+    void push(const StepProfile &profile) ;
+
+private:
+
+    std::vector<StepProfile> buffer_ ;
+    size_t head_ = 0, size_ = 0 ;
+} ;
+
+}}
+
+#endif
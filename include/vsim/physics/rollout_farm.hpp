@@ -0,0 +1,69 @@
+#ifndef __VSIM_PHYSICS_ROLLOUT_FARM_HPP__
+#define __VSIM_PHYSICS_ROLLOUT_FARM_HPP__
+
+#include <memory>
+#include <functional>
+
+#include <vsim/physics/world.hpp>
+
+namespace vsim { namespace physics {
+
+class ShapeLibrary ;
+
+// Runs rollouts of a scene in forked worker processes instead of threads, so that workers share no allocator or Bullet
+// global state. The scene and its collision shapes are built once in the parent and inherited copy-on-write by the workers,
+// which only create their own bodies, broadphase and solver. Trajectories and rewards are written by the workers to a
+// shared memory mapping read in place by the parent. POSIX only.
+
+class RolloutFarm {
+public:
+
+    // Computes the actions of a step (numBodies() * WorldBatch::ACTION_SIZE values, zero on entry) from the state of all bodies
+    // before the step (numBodies() * WorldBatch::STATE_SIZE values) and returns the reward of the step. It runs in a worker
+    // process so it may not modify the memory of the parent, it should use the results instead.
+    typedef std::function<float (size_t rollout, size_t step, const float *state, float *actions)> Policy ;
+
+    // called in the parent as soon as a rollout has been completed by a worker
+    typedef std::function<void (size_t rollout)> Callback ;
+
+    // n_workers is the number of processes forked by each run (zero for the number of cores). Worlds of the workers are
+    // never multithreaded.
+    RolloutFarm(const PhysicsScenePtr &scene, const WorldConfig &config = WorldConfig(), size_t n_workers = 0) ;
+    ~RolloutFarm() ;
+
+    size_t numWorkers() const { return n_workers_ ; }
+    size_t numBodies() const { return n_bodies_ ; }
+
+    // Run n_rollouts of n_steps steps of dt seconds each (a single fixed time step if zero), all starting from the initial
+    // state of the scene. Blocks until all rollouts are done and throws if a worker fails. The results stay valid until the
+    // next run.
+    void run(size_t n_rollouts, size_t n_steps, const Policy &policy, const Callback &on_done = nullptr, float dt = 0) ;
+
+    // state of all bodies after each step of a rollout, n_steps * numBodies() * WorldBatch::STATE_SIZE values
+    const float *states(size_t rollout) const ;
+
+    // reward of each step of a rollout, n_steps values
+    const float *rewards(size_t rollout) const ;
+
+private:
+
+    void releaseResults() ;
+
+    // loop of a worker process, returns the exit status
+    int work(const Policy &policy, int notify_fd, float dt) ;
+
+    PhysicsScenePtr scene_ ;
+    WorldConfig config_ ;
+    std::shared_ptr<ShapeLibrary> shapes_ ;
+    size_t n_workers_, n_bodies_ ;
+
+    // shared mapping holding the rollout counter followed by the states and rewards of all rollouts
+    void *shared_ = nullptr ;
+    size_t shared_size_ = 0 ;
+    size_t n_rollouts_ = 0, n_steps_ = 0 ;
+    float *states_ = nullptr, *rewards_ = nullptr ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef __VSIM_PHYSICS_TRAJECTORY_HPP__
+#define __VSIM_PHYSICS_TRAJECTORY_HPP__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+
+#include <Eigen/Geometry>
+
+#include <vsim/env/scene_fwd.hpp>
+
+namespace vsim { namespace physics {
+
+// Trajectory files store the state of a fixed set of bodies at every recorded step. Steps are grouped in chunks and
+// within each chunk every scalar attribute (time, position x, position y, ...) is stored as a separate zlib compressed
+// column with values ordered by step and then by body. An index at the end of the file gives the location of each column
+// so that any (step, body) pair may be accessed by decompressing only the columns of a single chunk.
+
+namespace detail {
+
+// time followed by the 13 state values
+static const size_t TRAJECTORY_COLUMNS = 14 ;
+
+// index entry of a chunk
+struct TrajectoryChunk {
+    uint32_t n_steps_ ;
+    uint64_t offsets_[TRAJECTORY_COLUMNS] ;
+    uint32_t sizes_[TRAJECTORY_COLUMNS] ;
+};
+
+}
+
+class TrajectoryException: public std::runtime_error {
+public:
+    TrajectoryException(const std::string &msg): std::runtime_error(msg) {}
+};
+
+class TrajectoryRecorder {
+public:
+
+    // Records the bodies of the scene in the same order as World (scene bodies followed by the bodies of each model).
+    // The file is written when a chunk of chunk_size steps is complete and finalized by close() or the destructor. Write
+    // errors are thrown by record() and close(); the destructor ignores them, call close() to detect them.
+    TrajectoryRecorder(const std::string &fname, const PhysicsScenePtr &scene, size_t chunk_size = 256, int compression_level = 6) ;
+    TrajectoryRecorder(const std::string &fname, const std::vector<const RigidBody *> &bodies, size_t chunk_size = 256, int compression_level = 6) ;
+    ~TrajectoryRecorder() ;
+
+    // append the current pose, velocity and angular velocity of all bodies
+    void record(float time) ;
+
+    // write any pending steps and the index, throws if the file could not be written
+    void close() ;
+
+private:
+
+    void open(const std::string &fname) ;
+    void checkStream() ;
+    void flush() ;
+    void writeColumn(const float *data, size_t n) ;
+
+    std::ofstream strm_ ;
+    std::string fname_ ;
+    std::vector<const RigidBody *> bodies_ ;
+    size_t chunk_size_ ;
+    int compression_level_ ;
+
+    size_t n_steps_ = 0 ; // steps in current chunk
+    std::vector<float> columns_[detail::TRAJECTORY_COLUMNS] ;
+    std::vector<uint8_t> shuffled_, compressed_ ;
+    std::vector<detail::TrajectoryChunk> index_ ;
+} ;
+
+class TrajectoryReader {
+public:
+
+    // number of values in a full state record, same layout as WorldBatch::STATE_SIZE
+    static const size_t STATE_SIZE = 13 ;
+
+    // memory maps the file and reads the index, columns are decompressed on demand
+    TrajectoryReader(const std::string &fname) ;
+    ~TrajectoryReader() ;
+
+    size_t numSteps() const { return n_steps_ ; }
+    size_t numBodies() const { return body_ids_.size() ; }
+    const std::vector<std::string> &bodyIds() const { return body_ids_ ; }
+
+    float time(size_t step) ;
+
+    Eigen::Vector3f position(size_t step, size_t body) ;
+    Eigen::Quaternionf orientation(size_t step, size_t body) ;
+    Eigen::Vector3f velocity(size_t step, size_t body) ;
+    Eigen::Vector3f angularVelocity(size_t step, size_t body) ;
+
+    // position, orientation quaternion (x, y, z, w), linear and angular velocity
+    void getState(size_t step, size_t body, float *state) ;
+
+private:
+
+    float value(size_t column, size_t step, size_t body) ;
+    const float *decodeColumn(size_t column, size_t chunk) ;
+
+    const uint8_t *data_ = nullptr ;
+    size_t size_ = 0 ;
+
+    std::vector<std::string> body_ids_ ;
+    size_t chunk_size_, n_steps_ ;
+    std::vector<detail::TrajectoryChunk> index_ ;
+
+    // last decoded chunk of each column
+    std::vector<float> columns_[detail::TRAJECTORY_COLUMNS] ;
+    size_t cached_chunk_[detail::TRAJECTORY_COLUMNS] ;
+    std::vector<uint8_t> shuffled_ ;
+} ;
+
+}}
+
+#endif
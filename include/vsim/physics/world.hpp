@@ -0,0 +1,211 @@
+#ifndef __VSIM_PHYSICS_WORLD_HPP__
+#define __VSIM_PHYSICS_WORLD_HPP__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <Eigen/Core>
+
+#include <vsim/env/scene_fwd.hpp>
+#include <vsim/physics/contact_stream.hpp>
+#include <vsim/physics/profiler.hpp>
+
+namespace vsim { namespace physics {
+
+class WorldImpl ;
+
+// Approximate convex decomposition of the triangle meshes of dynamic bodies. When disabled dynamic meshes are approximated
+// by a single convex hull. Convex meshes result in a single part anyway so enabling it only costs preprocessing time (cached with shape_cache_dir_).
+
+struct ConvexDecompositionParams {
+    bool enabled_ = false ;
+    size_t max_parts_ = 16 ;          // maximum number of convex parts per mesh
+    float concavity_ = 0.02f ;        // parts are split while their concavity exceeds this fraction of the mesh bounding box diagonal
+    size_t max_part_vertices_ = 32 ;  // hull vertices per part, more vertices are more accurate but slower in collision detection
+};
+
+// Adaptive substepping. When enabled World::step(dt) divides dt into internal steps whose size follows the state of the
+// simulation instead of steps of WorldConfig::time_step_. After each internal step the deepest contact penetration and the
+// distance that contacts close within one step (approach velocity times step size) are compared to max_penetration_: if
+// either exceeds it the step is rejected and taken again from the state before it at half the size (down to
+// min_time_step_), while both are well below it the step grows slowly. If a wall clock budget is given the steps are
+// coarsened (up to max_time_step_) when the remaining steps of World::step would not fit in it, but never beyond the size
+// asked for by the last rejected step. The budget is best effort: dt is always simulated completely, so a step may take
+// longer than the budget when even steps of max_time_step_ or the refinement at impacts do not fit in it.
+
+struct AdaptiveSteppingParams {
+    bool enabled_ = false ;
+    float min_time_step_ = 1.f/1000.f ;
+    float max_time_step_ = 1.f/30.f ;
+    float max_penetration_ = 0.005f ;
+    float budget_ = 0 ;                   // seconds of wall clock time per call to World::step (best effort), unlimited if zero
+};
+
+// Broadphase collision detection algorithm. The dynamic AABB tree adapts to any scene. Sweep and prune (Bullet's axis sweep)
+// is usually faster for many bodies moving within a bounded region, bodies outside of WorldConfig::world_min_, world_max_ are
+// still handled but less efficiently.
+
+enum class Broadphase { DYNAMIC_AABB_TREE, SWEEP_AND_PRUNE } ;
+
+// parameters of the simulation world
+
+struct WorldConfig {
+    Eigen::Vector3f gravity_ = { 0.f, -9.81f, 0.f } ;
+    float time_step_ = 1.f/60.f ;  // fixed internal time step of the solver
+    int max_sub_steps_ = 1 ;        // maximum number of internal steps performed in a single call to World::step
+
+    // Run collision detection and the constraint solver in parallel on the process wide thread pool (util::ThreadPool::instance()).
+    // This pays off for large scenes and requires Bullet to be built with BT_THREADSAFE.
+    bool multithreaded_ = false ;
+
+    // Build models whose bodies are linked by a tree of hinges as Featherstone multibodies in reduced coordinates instead of
+    // rigid bodies with constraints. This is faster and does not drift for long chains; the first body of each model is the
+    // base which is fixed if it is static. Such worlds are never multithreaded and constraints between models are not supported.
+    bool multibody_ = false ;
+
+    // Enable continuous collision detection of dynamic bodies with the settings of RigidBody, so that thin or fast bodies do
+    // not tunnel through each other at large time steps. Multibody links are not covered.
+    bool continuous_collision_ = true ;
+
+    Broadphase broadphase_ = Broadphase::DYNAMIC_AABB_TREE ;
+
+    // region where the bodies are expected to move, used for quantization of coordinates by the sweep and prune broadphase
+    Eigen::Vector3f world_min_ = { -1000.f, -1000.f, -1000.f }, world_max_ = { 1000.f, 1000.f, 1000.f } ;
+
+    // directory where collision data cooked from meshes (e.g. convex hulls) is cached across runs, disabled if empty
+    std::string shape_cache_dir_ ;
+
+    ConvexDecompositionParams convex_decomposition_ ;
+
+    AdaptiveSteppingParams adaptive_stepping_ ;
+};
+
+class PhysicsException: public std::runtime_error {
+public:
+    PhysicsException(const std::string &msg): std::runtime_error(msg) {}
+};
+
+// Bullet simulation of a PhysicsScene. Bodies and constraints are instantiated once on construction, after each step
+// the resulting poses and velocities are written back to the RigidBody objects of the scene
+
+class World {
+public:
+
+    World(const PhysicsScenePtr &scene, const WorldConfig &config = WorldConfig()) ;
+    ~World() ;
+
+    // advance the simulation by dt seconds (a single fixed time step if zero) and update the scene bodies that moved along
+    // with their visual nodes
+    void step(float dt = 0) ;
+
+    // bodies are indexed in the order they appear in the scene; first the scene bodies and then the bodies of each model
+    size_t numBodies() const ;
+    RigidBody *body(size_t idx) const ;
+
+    // Indices of the bodies whose pose was written back to the scene by the last step (or restore), in increasing order.
+    // Sleeping and static bodies are not written, neither are the transforms of their visual nodes, so a renderer may keep
+    // the transforms it uploaded for all other bodies.
+    const std::vector<size_t> &activeBodies() const ;
+
+    // Write the poses of all bodies as a structure of POSE_SIZE arrays of numBodies() values (see pose_interpolation.hpp).
+    // Keeping the poses of the last two steps lets a renderer interpolate between them with interpolatePoses().
+    void getPoses(float *poses) const ;
+
+    // Bulk state exchange for controllers. Each buffer holds one record per body indexed like body(): positions and linear and
+    // angular velocities take 3 values per body, orientations 4 (quaternion x, y, z, w). Null buffers are skipped.
+    void getStates(float *pos, float *quat, float *linvel, float *angvel) const ;
+
+    // Apply forces and torques (3 values per body each, either may be null) during the next step. Static bodies and zero
+    // entries are skipped, other bodies are woken up.
+    void applyForces(const float *forces, const float *torques = nullptr) ;
+
+    // Apply linear and angular impulses (3 values per body each, either may be null) immediately. Multibody bodies have no
+    // impulse interface so their impulses are applied as forces over the next internal step only, with the same change of
+    // momentum once that step has been taken.
+    void applyImpulses(const float *impulses, const float *angular_impulses = nullptr) ;
+
+    // returns the index of the body with the given id or -1 if not found
+    int findBody(const std::string &id) const ;
+
+    // simulated time since the world was created
+    float time() const ;
+
+    // number of internal steps taken by the last call to step() and, with adaptive stepping, the size of the next internal step
+    size_t numSubSteps() const ;
+    float subStepSize() const ;
+
+    // number of distinct Bullet collision shapes and number of body shapes that reused an identical existing shape
+    size_t numCollisionShapes() const ;
+    size_t numSharedCollisionShapes() const ;
+
+    // Cast n rays against all bodies regardless of their collision filters. The rays are cast in parallel on the process wide
+    // thread pool if the broadphase is the dynamic AABB tree and Bullet is version 2.88 or later, otherwise one after the
+    // other through the Bullet world, which is not thread safe. Inputs and outputs are structures of arrays:
+    // origins and directions hold the x coordinates of all rays followed by the y and z coordinates (3n values each), directions need
+    // not be normalized. For each ray the distance to the closest hit is written to out_distances (max_dist if nothing is hit
+    // within max_dist), the world space normal at the hit to out_normals (3n values, zero if no hit) and the index of the body hit
+    // to out_bodies (-1 if no hit). The last two may be null. No memory is allocated per ray.
+    void rayCastBatch(size_t n, const float *origins, const float *directions, float max_dist,
+                      float *out_distances, float *out_normals = nullptr, int *out_bodies = nullptr) const ;
+
+    // Report the contacts between bodies after each internal step in a stream of the given capacity owned by the world,
+    // replacing any previously enabled stream, so that short contacts within a step are not missed. Nothing is done in
+    // internal steps where no bodies are or were in contact. Throws if the filter refers to unknown bodies or models.
+    ContactStream &enableContactEvents(const ContactFilter &filter = ContactFilter(), size_t capacity = 4096) ;
+    void disableContactEvents() ;
+
+    // the enabled contact stream or null
+    ContactStream *contactStream() const ;
+
+    // Record the timings of the phases of each step and the number of pairs, manifolds and contacts in a history of the given
+    // capacity owned by the world, replacing any previously enabled profiler. Phase timings rely on the profiling hooks of
+    // Bullet which are taken over for the whole process, so Bullet's own CProfileManager stops collecting.
+    StepProfiler &enableProfiling(size_t capacity = 1024) ;
+    void disableProfiling() ;
+
+    // the enabled profiler or null
+    StepProfiler *profiler() const ;
+
+    // Joints, one per hinge. Hinges of models simulated as multibodies come first, ordered by model and within each model
+    // by link (breadth first from the base), and are followed by hinge constraints between rigid bodies in scene order.
+    // Positions, velocities and torques are contiguous arrays of numJoints() values. Multibody angles are relative to the
+    // initial pose while hinge constraints report the angle their limits refer to. Torques are applied during the next step.
+    size_t numJoints() const ;
+    int findJoint(const std::string &id) const ;
+    void getJointPositions(float *q) const ;
+    void getJointVelocities(float *qd) const ;
+    void setJointTorques(const float *tau) ;
+
+    // Joint space PD controllers evaluated before every internal step, so that the control bandwidth is that of the solver
+    // and not of the calls to step(). The torque of joint i is kp[i] (q_target[i] - q) + kd[i] (qd_target[i] - qd), clamped
+    // to max_torque[i], in addition to the torques of setJointTorques(). A velocity controller has kp zero. Controllers are
+    // disabled while all gains are zero (the default). Arrays hold numJoints() values; null gains are zero, null targets are
+    // left unchanged and null limits remove the limits.
+    void setJointGains(const float *kp, const float *kd) ;
+    void setJointTargets(const float *q, const float *qd) ;
+    void setJointTorqueLimits(const float *max_torque) ;
+
+    // Saves the dynamic state of the world (body transforms, velocities, activation state, constraint impulses and cached
+    // contact points used for warm starting, time accumulated towards the next fixed step) in an internal buffer and returns a
+    // handle to it. Restoring a snapshot rewinds the world to the saved state so that the same steps replay the same motion;
+    // contact points are only restored for pairs whose contact manifold still exists. Contact events after a restore are
+    // relative to the restored contacts, events already in the stream are kept. Storage of released snapshots is
+    // recycled so that after reserveSnapshots() taking and restoring snapshots does not allocate once the contact storage of
+    // the slots has grown.
+    typedef size_t SnapshotHandle ;
+
+    SnapshotHandle snapshot() ;
+    void restore(SnapshotHandle handle) ;
+    void releaseSnapshot(SnapshotHandle handle) ;
+    void reserveSnapshots(size_t n) ;
+
+private:
+
+    std::unique_ptr<WorldImpl> impl_ ;
+} ;
+
+}}
+
+#endif
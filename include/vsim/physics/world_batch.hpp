@@ -0,0 +1,53 @@
+#ifndef __VSIM_PHYSICS_WORLD_BATCH_HPP__
+#define __VSIM_PHYSICS_WORLD_BATCH_HPP__
+
+#include <memory>
+#include <vector>
+
+#include <vsim/physics/world.hpp>
+#include <vsim/util/thread_pool.hpp>
+
+namespace vsim { namespace physics {
+
+class WorldImpl ;
+class ShapeLibrary ;
+
+// A batch of independent replicas of the same physics scene stepped in parallel. Collision shapes are created once and
+// shared by all replicas. The scene itself is only read when the replicas are created, body states are exchanged through flat arrays.
+
+class WorldBatch {
+public:
+
+    // number of floats per body in the action and state arrays
+    static const size_t ACTION_SIZE = 6 ;  // force (x, y, z), torque (x, y, z)
+    static const size_t STATE_SIZE = 13 ;  // position (x, y, z), orientation quaternion (x, y, z, w), linear velocity, angular velocity
+
+    // Create n_worlds replicas of the scene. They are stepped on the process wide thread pool unless n_threads is not zero,
+    // in which case the batch gets a pool of its own of that size. The replicas are single threaded worlds,
+    // config.multithreaded_ is ignored.
+    WorldBatch(const PhysicsScenePtr &scene, size_t n_worlds, const WorldConfig &config = WorldConfig(), size_t n_threads = 0) ;
+    ~WorldBatch() ;
+
+    size_t size() const { return worlds_.size() ; }
+    size_t numBodies() const { return n_bodies_ ; }
+
+    // Apply actions and advance all replicas by a single step (dt = 0) or by dt seconds. Actions are laid out per world and
+    // per body, i.e. size() * numBodies() * ACTION_SIZE values, and may be null. If out_states is not null it receives
+    // size() * numBodies() * STATE_SIZE values with the state of all bodies after the step.
+    void step(const float *actions, float *out_states, float dt = 0) ;
+
+    // current state of all replicas with the same layout as in step
+    void getStates(float *states) const ;
+
+private:
+
+    std::shared_ptr<ShapeLibrary> shapes_ ;
+    std::vector<std::unique_ptr<WorldImpl>> worlds_ ;
+    size_t n_bodies_ ;
+    std::unique_ptr<util::ThreadPool> own_pool_ ;
+    util::ThreadPool &pool_ ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef __VSIM_UTIL_THREAD_POOL_HPP__
+#define __VSIM_UTIL_THREAD_POOL_HPP__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <type_traits>
+
+namespace vsim { namespace util {
+
+// Fixed size pool of worker threads executing data parallel loops. The calling thread takes part in the loop so
+// a pool with n threads spawns n-1 workers. Loops are dispatched without allocations so that they may be called every simulation step.
+
+class ThreadPool {
+public:
+
+    // use as many threads as the hardware supports if n_threads is zero
+    explicit ThreadPool(size_t n_threads = 0) ;
+    ~ThreadPool() ;
+
+    ThreadPool(const ThreadPool &) = delete ;
+    ThreadPool &operator = (const ThreadPool &) = delete ;
+
+    // total number of threads including the calling thread
+    size_t numThreads() const { return workers_.size() + 1 ; }
+
+    // calls f(i) for each i in [0, n) and blocks until all calls are done. Indices are handed out dynamically to the threads.
+    // Loops issued from within a task are executed serially by the calling worker. The first exception thrown by a task is
+    // rethrown in the calling thread.
+    template<class F>
+    void parallelFor(size_t n, F &&f) {
+        typedef typename std::remove_reference<F>::type Fn ;
+        run(n, &invoke<Fn>, (void *)&f) ;
+    }
+
+    // index of the current thread in [0, numThreads()), the thread that issued the loop has index 0
+    static size_t threadIndex() ;
+
+    // process wide pool with one thread per core, shared by subsystems that would otherwise oversubscribe the cores
+    static ThreadPool &instance() {
+        static ThreadPool instance_ ;
+        return instance_ ;
+    }
+
+private:
+
+    typedef void (*TaskFn)(void *, size_t) ;
+
+    template<class Fn>
+    static void invoke(void *ctx, size_t i) {
+        (*static_cast<Fn *>(ctx))(i) ;
+    }
+
+    void run(size_t n, TaskFn fn, void *ctx) ;
+    void execute() ;
+    void workerLoop(size_t idx) ;
+
+    std::vector<std::thread> workers_ ;
+
+    std::mutex run_mutex_ ; // serializes loops issued concurrently by different threads
+    std::mutex mutex_ ;
+    std::condition_variable start_cond_, done_cond_ ;
+
+    TaskFn fn_ = nullptr ;
+    void *ctx_ = nullptr ;
+    size_t n_tasks_ = 0 ;
+    std::atomic<size_t> next_task_ ;
+    size_t busy_ = 0 ;
+    unsigned long generation_ = 0 ;
+    bool stop_ = false ;
+    std::exception_ptr error_ ;
+} ;
+
+} // namespace util
+} // namespace vsim
+
+#endif
@@ -0,0 +1,56 @@
+#include <vsim/env/geometry.hpp>
+#include <vsim/util/format.hpp>
+
+#include <FreeImage.h>
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std ;
+
+namespace vsim {
+
+void HeightfieldGeometry::load(const string &fpath, float max_height) {
+
+    FIBITMAP *image = FreeImage_Load(FreeImage_GetFileType(fpath.c_str(), 0), fpath.c_str()) ;
+
+    if ( !image )
+        throw runtime_error(util::format("cannot load heightfield image \"%\"", fpath)) ;
+
+    // 8-bit images are also accepted but give visible terraces
+
+    FIBITMAP *gray = ( FreeImage_GetImageType(image) == FIT_UINT16 ) ? image : FreeImage_ConvertToUINT16(image) ;
+
+    if ( !gray ) {
+        FreeImage_Unload(image) ;
+        throw runtime_error(util::format("unsupported heightfield image format \"%\"", fpath)) ;
+    }
+
+    n_cols_ = FreeImage_GetWidth(gray) ;
+    n_rows_ = FreeImage_GetHeight(gray) ;
+    heights_.resize(n_cols_ * n_rows_) ;
+
+    float scale = max_height/65535.f ;
+
+    // FreeImage stores scanlines bottom-up
+
+    for( size_t r=0 ; r<n_rows_ ; r++ ) {
+        const uint16_t *src = reinterpret_cast<const uint16_t *>(FreeImage_GetScanLine(gray, n_rows_ - 1 - r)) ;
+        float *dst = &heights_[r * n_cols_] ;
+        for( size_t c=0 ; c<n_cols_ ; c++ )
+            dst[c] = src[c] * scale ;
+    }
+
+    if ( gray != image ) FreeImage_Unload(gray) ;
+    FreeImage_Unload(image) ;
+
+    if ( heights_.empty() ) {
+        min_height_ = max_height_ = 0 ;
+    } else {
+        auto mm = std::minmax_element(heights_.begin(), heights_.end()) ;
+        min_height_ = *mm.first ;
+        max_height_ = *mm.second ;
+    }
+}
+
+}
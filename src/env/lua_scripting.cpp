@@ -120,6 +120,18 @@ static RigidBodyPtr lua_create_rigid_body(sol::table t) {
         } else if ( v.is<Visual>() ) {
             Visual e = v.as<Visual>() ;
             p->visual_ = e.node_ ;
+        } else if ( c.first.is<string>() ) {
+            string attr = c.first.as<string>() ;
+            if ( attr == "mass" )
+                p->mass_ = v.as<float>() ;
+            else if ( attr == "ccd_radius" )
+                p->ccd_swept_sphere_radius_ = v.as<float>() ;
+            else if ( attr == "ccd_threshold" )
+                p->ccd_motion_threshold_ = v.as<float>() ;
+            else if ( attr == "collision_group" )
+                p->collision_group_ = v.as<int>() ;
+            else if ( attr == "collision_mask" )
+                p->collision_mask_ = v.as<int>() ;
         }
 
     }
@@ -135,8 +147,15 @@ static CollisionShapePtr lua_create_collision_shape(sol::table t) {
         if ( c.second.is<BoxGeometry>() ) {
             GeometryPtr e = c.second.as<std::shared_ptr<BoxGeometry>>() ;
             p->geom_ = e ;
+        } else if ( c.second.is<HeightfieldGeometry>() ) {
+            GeometryPtr e = c.second.as<HeightfieldGeometryPtr>() ;
+            p->geom_ = e ;
         } else if ( c.first.is<string>() ) {
             string attr = c.first.as<string>() ;
+            if ( attr == "collision_group" )
+                p->collision_group_ = c.second.as<int>() ;
+            else if ( attr == "collision_mask" )
+                p->collision_mask_ = c.second.as<int>() ;
         }
     }
 
@@ -190,6 +209,38 @@ static PlaneGeometryPtr lua_create_plane_geometry(sol::table t) {
     return p ;
 }
 
+// Heightfield { src = "terrain.png", size = { 100, 100 }, height = 10 }
+
+static HeightfieldGeometryPtr lua_create_heightfield_geometry(sol::table t) {
+
+    HeightfieldGeometryPtr p(new HeightfieldGeometry());
+
+    string src ;
+    float max_height = 1.0 ;
+
+    for( auto &&c: t ) {
+        auto &&v = c.second ;
+        if ( !c.first.is<string>() ) continue ;
+
+        string attr = c.first.as<string>() ;
+        if ( attr == "src" )
+            src = v.as<string>() ;
+        else if ( attr == "height" )
+            max_height = v.as<float>() ;
+        else if ( attr == "size" ) {
+            sol::table st = v.as<sol::table>() ;
+            sol::optional<float> sx = st[1], sz = st[2] ;
+            if ( sx && sz ) p->size_ = Vector2f(sx.value(), sz.value()) ;
+        }
+    }
+
+    if ( src.empty() ) return nullptr ;
+
+    p->load(src, max_height) ;
+
+    return p ;
+}
+
 struct MTranslate {
     Vector3f translation_ ;
 };
@@ -279,6 +330,10 @@ ScenePtr Scene::loadFromString(const string &src) {
         sol::call_constructor, sol::factories(&lua_create_plane_geometry)
     );
 
+    lua.new_usertype<HeightfieldGeometry>("Heightfield",
+        sol::call_constructor, sol::factories(&lua_create_heightfield_geometry)
+    );
+
     lua.new_usertype<Pose>("Pose",
         sol::call_constructor, sol::factories(&lua_create_pose)
     );
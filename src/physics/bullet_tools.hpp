@@ -0,0 +1,40 @@
+#ifndef __VSIM_PHYSICS_BULLET_TOOLS_HPP__
+#define __VSIM_PHYSICS_BULLET_TOOLS_HPP__
+
+#include <btBulletDynamicsCommon.h>
+
+#include <Eigen/Geometry>
+
+// conversions between Eigen and Bullet types, these are used in the per-step loops so they should not allocate
+
+namespace vsim { namespace physics {
+
+inline btVector3 toBullet(const Eigen::Vector3f &v) {
+    return btVector3(v.x(), v.y(), v.z()) ;
+}
+
+// scaling is not supported by Bullet transforms so only the rotation part of the matrix is kept
+inline btTransform toBullet(const Eigen::Affine3f &tf) {
+    Eigen::Quaternionf q(tf.rotation()) ;
+    const Eigen::Vector3f &t = tf.translation() ;
+    return btTransform(btQuaternion(q.x(), q.y(), q.z(), q.w()), btVector3(t.x(), t.y(), t.z())) ;
+}
+
+inline void fromBullet(const btVector3 &src, Eigen::Vector3f &dst) {
+    dst.x() = src.x() ; dst.y() = src.y() ; dst.z() = src.z() ;
+}
+
+inline void fromBullet(const btTransform &src, Eigen::Affine3f &dst) {
+    const btMatrix3x3 &r = src.getBasis() ;
+    const btVector3 &o = src.getOrigin() ;
+
+    Eigen::Matrix4f &m = dst.matrix() ;
+    m(0, 0) = r[0][0] ; m(0, 1) = r[0][1] ; m(0, 2) = r[0][2] ; m(0, 3) = o.x() ;
+    m(1, 0) = r[1][0] ; m(1, 1) = r[1][1] ; m(1, 2) = r[1][2] ; m(1, 3) = o.y() ;
+    m(2, 0) = r[2][0] ; m(2, 1) = r[2][1] ; m(2, 2) = r[2][2] ; m(2, 3) = o.z() ;
+    m(3, 0) = 0 ; m(3, 1) = 0 ; m(3, 2) = 0 ; m(3, 3) = 1 ;
+}
+
+}}
+
+#endif
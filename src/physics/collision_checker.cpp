@@ -0,0 +1,201 @@
+#include <vsim/physics/collision_checker.hpp>
+
+#include "shape_library.hpp"
+#include "bullet_tools.hpp"
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/rigid_body_constraint.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <algorithm>
+#include <map>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+const size_t CollisionChecker::POSE_SIZE ;
+
+// Collision world owned by a single thread. Model bodies come first in the object table followed by the obstacles, the index
+// in the table is stored as the user index of each object. Broadphase pairs are not needed so they are not cached.
+
+struct CollisionChecker::Context {
+
+    Context(): dispatcher_(&collision_conf_), broadphase_(&pair_cache_), world_(&dispatcher_, &broadphase_, &collision_conf_) {}
+
+    ~Context() {
+        for( auto &obj: objects_ )
+            world_.removeCollisionObject(obj.get()) ;
+    }
+
+    void addObject(btCollisionShape *shape, const Affine3f &pose, bool is_static, int group, int mask) {
+        btCollisionObject *obj = new btCollisionObject() ;
+        obj->setCollisionShape(shape) ;
+        obj->setWorldTransform(toBullet(pose)) ;
+        obj->setUserIndex(objects_.size()) ;
+        if ( is_static )
+            obj->setCollisionFlags(obj->getCollisionFlags() | btCollisionObject::CF_STATIC_OBJECT) ;
+
+        world_.addCollisionObject(obj, group, mask) ;
+        objects_.emplace_back(obj) ;
+    }
+
+    btDefaultCollisionConfiguration collision_conf_ ;
+    btCollisionDispatcher dispatcher_ ;
+    btNullPairCache pair_cache_ ;
+    btDbvtBroadphase broadphase_ ;
+    btCollisionWorld world_ ;
+
+    vector<unique_ptr<btCollisionObject>> objects_ ;
+    vector<const btCollisionObject *> candidates_ ;  // reused across queries
+};
+
+namespace {
+
+struct CandidateCollector: public btBroadphaseAabbCallback {
+    CandidateCollector(vector<const btCollisionObject *> &candidates): candidates_(candidates) {}
+
+    bool process(const btBroadphaseProxy *proxy) override {
+        candidates_.push_back(static_cast<const btCollisionObject *>(proxy->m_clientObject)) ;
+        return true ;
+    }
+
+    vector<const btCollisionObject *> &candidates_ ;
+};
+
+struct PairDistanceCallback: public btCollisionWorld::ContactResultCallback {
+    btScalar addSingleResult(btManifoldPoint &cp, const btCollisionObjectWrapper *, int, int, const btCollisionObjectWrapper *, int, int) override {
+        min_distance_ = std::min(min_distance_, cp.getDistance()) ;
+        return 0 ;
+    }
+
+    btScalar min_distance_ = BT_LARGE_FLOAT ;
+};
+
+}
+
+CollisionChecker::CollisionChecker(const PhysicsScenePtr &scene, const PhysicsModelPtr &model, const WorldConfig &config, size_t n_threads):
+    shapes_(new ShapeLibrary(scene, config)), n_bodies_(model->bodies_.size()),
+    own_pool_(n_threads ? new util::ThreadPool(n_threads) : nullptr), pool_(own_pool_ ? *own_pool_ : util::ThreadPool::instance()) {
+
+    vector<const RigidBody *> bodies, obstacles ;
+    map<const RigidBody *, size_t> body_index ;
+
+    for( const RigidBodyPtr &b: model->bodies_ ) {
+        body_index[b.get()] = bodies.size() ;
+        bodies.push_back(b.get()) ;
+        if ( !shapes_->find(b.get()) )
+            throw PhysicsException(util::format("body \"%\" of the model is not part of the scene", b->id_)) ;
+    }
+
+    for( const RigidBodyPtr &b: scene->bodies_ )
+        obstacles.push_back(b.get()) ;
+
+    for( const PhysicsModelPtr &m: scene->models_ ) {
+        if ( m == model ) continue ;
+        for( const RigidBodyPtr &b: m->bodies_ )
+            obstacles.push_back(b.get()) ;
+    }
+
+    // without self collisions no pair of model bodies is checked
+    linked_.resize(n_bodies_ * n_bodies_, !model->self_collisions_) ;
+
+    for( const RigidBodyConstraintPtr &c: model->constraints_ ) {
+        auto ia = body_index.find(c->a_.get()), ib = body_index.find(c->b_.get()) ;
+        if ( ia == body_index.end() || ib == body_index.end() ) continue ;
+        linked_[ia->second * n_bodies_ + ib->second] = true ;
+        linked_[ib->second * n_bodies_ + ia->second] = true ;
+    }
+
+    contexts_.resize(pool_.numThreads()) ;
+
+    pool_.parallelFor(contexts_.size(), [&](size_t i) {
+        Context *ctx = new Context() ;
+        contexts_[i].reset(ctx) ;
+
+        int group, mask ;
+
+        // model bodies are moved by the checker so they collide with static obstacles whatever their mass
+        for( const RigidBody *b: bodies ) {
+            ShapeLibrary::collisionFilter(*b, false, group, mask) ;
+            ctx->addObject(shapes_->find(b), Affine3f(b->pose_.absolute()), false, group, mask) ;
+        }
+
+        for( const RigidBody *b: obstacles ) {
+            ShapeLibrary::collisionFilter(*b, b->isStatic(), group, mask) ;
+            ctx->addObject(shapes_->find(b), Affine3f(b->pose_.absolute()), true, group, mask) ;
+        }
+    }) ;
+}
+
+CollisionChecker::~CollisionChecker() {
+}
+
+void CollisionChecker::check(size_t n, const float *poses, uint8_t *out_collisions, float *out_distances, float max_distance) {
+
+    // contexts are indexed by thread so batches may not overlap
+    lock_guard<mutex> lock(mutex_) ;
+
+    const size_t pose_stride = n_bodies_ * POSE_SIZE ;
+    const bool need_distance = out_distances != nullptr ;
+    const btScalar threshold = need_distance ? max_distance : 0 ;
+
+    pool_.parallelFor(n, [&](size_t c) {
+        // a loop issued from a worker of another pool runs serially with the index of that worker
+        Context &ctx = *contexts_[util::ThreadPool::threadIndex() % contexts_.size()] ;
+
+        const float *pose = poses + c * pose_stride ;
+
+        for( size_t i=0 ; i<n_bodies_ ; i++, pose += POSE_SIZE ) {
+            btCollisionObject *obj = ctx.objects_[i].get() ;
+            obj->setWorldTransform(btTransform(btQuaternion(pose[3], pose[4], pose[5], pose[6]), btVector3(pose[0], pose[1], pose[2]))) ;
+            ctx.world_.updateSingleAabb(obj) ;
+        }
+
+        bool collision = false ;
+        btScalar min_distance = max_distance ;
+
+        for( size_t i=0 ; i<n_bodies_ && !( collision && !need_distance ) ; i++ ) {
+            btCollisionObject *obj = ctx.objects_[i].get() ;
+            const btBroadphaseProxy *proxy = obj->getBroadphaseHandle() ;
+
+            btVector3 aabb_min, aabb_max, margin(threshold, threshold, threshold) ;
+            obj->getCollisionShape()->getAabb(obj->getWorldTransform(), aabb_min, aabb_max) ;
+
+            ctx.candidates_.clear() ;
+            CandidateCollector collector(ctx.candidates_) ;
+            ctx.broadphase_.aabbTest(aabb_min - margin, aabb_max + margin, collector) ;
+
+            for( const btCollisionObject *other: ctx.candidates_ ) {
+                size_t j = other->getUserIndex() ;
+
+                // pairs of model bodies are visited once
+                if ( j < n_bodies_ && ( j <= i || linked_[i * n_bodies_ + j] ) ) continue ;
+
+                const btBroadphaseProxy *other_proxy = other->getBroadphaseHandle() ;
+                if ( !( proxy->m_collisionFilterGroup & other_proxy->m_collisionFilterMask ) ||
+                     !( other_proxy->m_collisionFilterGroup & proxy->m_collisionFilterMask ) ) continue ;
+
+                PairDistanceCallback cb ;
+                cb.m_closestDistanceThreshold = threshold ;
+                ctx.world_.contactPairTest(obj, const_cast<btCollisionObject *>(other), cb) ;
+
+                min_distance = std::min(min_distance, cb.min_distance_) ;
+
+                if ( cb.min_distance_ < 0 ) {
+                    collision = true ;
+                    if ( !need_distance ) break ;
+                }
+            }
+        }
+
+        out_collisions[c] = collision ? 1 : 0 ;
+        if ( need_distance ) out_distances[c] = min_distance ;
+    }) ;
+}
+
+}}
@@ -0,0 +1,198 @@
+#include <vsim/physics/contact_stream.hpp>
+
+#include "world_impl.hpp"
+#include "bullet_tools.hpp"
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <algorithm>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+const size_t ContactEvent::MAX_POINTS ;
+
+ContactStream::ContactStream(size_t capacity): buffer_(std::max<size_t>(capacity, 1)) {
+}
+
+bool ContactStream::pop(ContactEvent &event) {
+    if ( size_ == 0 ) return false ;
+
+    event = buffer_[head_] ;
+    head_ = ( head_ + 1 ) % buffer_.size() ;
+    --size_ ;
+
+    return true ;
+}
+
+size_t ContactStream::read(ContactEvent *events, size_t max_events) {
+    size_t n = 0 ;
+    while ( n < max_events && pop(events[n]) ) ++n ;
+    return n ;
+}
+
+void ContactStream::clear() {
+    head_ = size_ = 0 ;
+}
+
+void ContactStream::push(const ContactEvent &event) {
+    if ( size_ == buffer_.size() ) {
+        buffer_[head_] = event ;
+        head_ = ( head_ + 1 ) % buffer_.size() ;
+        ++n_dropped_ ;
+    } else {
+        buffer_[( head_ + size_ ) % buffer_.size()] = event ;
+        ++size_ ;
+    }
+}
+
+ContactStream &WorldImpl::enableContactEvents(const ContactFilter &filter, size_t capacity) {
+
+    contact_mask_.assign(bodies_.size(), filter.bodies_.empty() && filter.models_.empty()) ;
+
+    for( const string &id: filter.bodies_ ) {
+        int idx = findBody(id) ;
+        if ( idx < 0 )
+            throw PhysicsException(util::format("contact filter refers to unknown body \"%\"", id)) ;
+        contact_mask_[idx] = 1 ;
+    }
+
+    for( const string &id: filter.models_ ) {
+        auto it = std::find_if(scene_->models_.begin(), scene_->models_.end(), [&](const PhysicsModelPtr &m) { return m->id_ == id ; }) ;
+        if ( it == scene_->models_.end() )
+            throw PhysicsException(util::format("contact filter refers to unknown model \"%\"", id)) ;
+
+        for( const RigidBodyPtr &b: (*it)->bodies_ )
+            contact_mask_[body_map_.at(b.get())] = 1 ;
+    }
+
+    contact_filter_ = filter ;
+    contact_stream_.reset(new ContactStream(capacity)) ;
+
+    contacts_.clear() ;
+    prev_contacts_.clear() ;
+
+    return *contact_stream_ ;
+}
+
+void WorldImpl::disableContactEvents() {
+    contact_stream_.reset() ;
+    contacts_.clear() ;
+    prev_contacts_.clear() ;
+}
+
+static bool pair_less(const ContactEvent &x, const ContactEvent &y) {
+    return x.body_a_ < y.body_a_ || ( x.body_a_ == y.body_a_ && x.body_b_ < y.body_b_ ) ;
+}
+
+void WorldImpl::gatherContacts(float t) {
+
+    btDispatcher *dispatcher = dynamics_world_->getDispatcher() ;
+    int n_manifolds = dispatcher->getNumManifolds() ;
+
+    contacts_.clear() ;
+
+    for( int i=0 ; i<n_manifolds ; i++ ) {
+        const btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i) ;
+        int n_points = manifold->getNumContacts() ;
+        if ( n_points == 0 ) continue ;
+
+        int a = manifold->getBody0()->getUserIndex(), b = manifold->getBody1()->getUserIndex() ;
+        if ( !contact_mask_[a] && !contact_mask_[b] ) continue ;
+
+        bool swapped = a > b ;
+        if ( swapped ) std::swap(a, b) ;
+
+        contacts_.emplace_back() ;
+        ContactEvent &e = contacts_.back() ;
+        e.type_ = ContactEvent::PERSIST ;
+        e.time_ = t ;
+        e.body_a_ = a ;
+        e.body_b_ = b ;
+        e.impulse_ = 0 ;
+        e.n_points_ = 0 ;
+
+        for( int k=0 ; k<n_points ; k++ ) {
+            const btManifoldPoint &cp = manifold->getContactPoint(k) ;
+            e.impulse_ += cp.getAppliedImpulse() ;
+
+            if ( e.n_points_ == ContactEvent::MAX_POINTS ) continue ;
+
+            ContactEvent::Point &p = e.points_[e.n_points_++] ;
+            fromBullet(swapped ? cp.getPositionWorldOnA() : cp.getPositionWorldOnB(), p.position_) ;
+            fromBullet(swapped ? -cp.m_normalWorldOnB : cp.m_normalWorldOnB, p.normal_) ;
+            p.distance_ = cp.getDistance() ;
+            p.impulse_ = cp.getAppliedImpulse() ;
+        }
+    }
+
+    std::sort(contacts_.begin(), contacts_.end(), pair_less) ;
+
+    // a pair may have several manifolds (e.g. compound shapes), merge them and drop pairs below the impulse threshold
+
+    size_t n = 0 ;
+    for( size_t i=0 ; i<contacts_.size() ; i++ ) {
+        const ContactEvent &e = contacts_[i] ;
+
+        if ( n > 0 && !pair_less(contacts_[n-1], e) ) {
+            ContactEvent &merged = contacts_[n-1] ;
+            merged.impulse_ += e.impulse_ ;
+            for( uint32_t k=0 ; k<e.n_points_ && merged.n_points_ < ContactEvent::MAX_POINTS ; k++ )
+                merged.points_[merged.n_points_++] = e.points_[k] ;
+        } else if ( n++ != i )
+            contacts_[n-1] = e ;
+    }
+
+    contacts_.resize(n) ;
+
+    if ( contact_filter_.min_impulse_ > 0 ) {
+        float min_impulse = contact_filter_.min_impulse_ ;
+        contacts_.erase(std::remove_if(contacts_.begin(), contacts_.end(), [min_impulse](const ContactEvent &e) { return e.impulse_ < min_impulse ; }),
+                        contacts_.end()) ;
+    }
+}
+
+void WorldImpl::collectContacts(float t) {
+
+    // no contacts now or after the previous internal step so no events either
+    if ( dynamics_world_->getDispatcher()->getNumManifolds() == 0 && prev_contacts_.empty() ) return ;
+
+    gatherContacts(t) ;
+
+    // both lists are sorted so the transitions are found by merging them
+
+    size_t i = 0, j = 0 ;
+    while ( i < contacts_.size() || j < prev_contacts_.size() ) {
+        if ( j == prev_contacts_.size() || ( i < contacts_.size() && pair_less(contacts_[i], prev_contacts_[j]) ) ) {
+            contacts_[i].type_ = ContactEvent::BEGIN ;
+            contact_stream_->push(contacts_[i++]) ;
+        } else if ( i == contacts_.size() || pair_less(prev_contacts_[j], contacts_[i]) ) {
+            ContactEvent e = prev_contacts_[j++] ;
+            e.type_ = ContactEvent::END ;
+            e.time_ = t ;
+            e.impulse_ = 0 ;
+            e.n_points_ = 0 ;
+            contact_stream_->push(e) ;
+        } else {
+            contacts_[i].type_ = ContactEvent::PERSIST ;
+            if ( !contact_filter_.transitions_only_ )
+                contact_stream_->push(contacts_[i]) ;
+            ++i ; ++j ;
+        }
+    }
+
+    // the storage of both lists is kept so that no allocations happen once they have grown to the typical number of contacts
+    prev_contacts_.swap(contacts_) ;
+}
+
+void WorldImpl::resetContacts() {
+    gatherContacts(time_) ;
+    prev_contacts_.swap(contacts_) ;
+}
+
+}}
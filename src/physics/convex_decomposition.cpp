@@ -0,0 +1,290 @@
+#include "convex_decomposition.hpp"
+
+#include <LinearMath/btConvexHullComputer.h>
+
+#include <Eigen/Geometry>
+
+#include <cmath>
+#include <limits>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+namespace {
+
+struct Hull {
+    vector<Vector3f> vertices_ ;
+    vector<Vector4f> planes_ ;   // outward normal n and offset d such that n.x <= d inside the hull
+    float volume_ = 0 ;
+};
+
+struct Part {
+    vector<uint32_t> triangles_ ;
+    Hull hull_ ;
+    float concavity_ = 0 ;
+};
+
+class Decomposition {
+public:
+
+    Decomposition(const Mesh &mesh): vertices_(mesh.vertices_), indices_(mesh.vertex_indices_), stamp_(mesh.vertices_.size(), 0) {
+        size_t n_triangles = indices_.size()/3 ;
+        centroids_.resize(n_triangles) ;
+        for( size_t t=0 ; t<n_triangles ; t++ )
+            centroids_[t] = ( vertices_[indices_[3*t]] + vertices_[indices_[3*t+1]] + vertices_[indices_[3*t+2]] )/3.f ;
+    }
+
+    // unique vertices referenced by the triangles
+    void collectPoints(const vector<uint32_t> &triangles, vector<Vector3f> &points) {
+        ++current_stamp_ ;
+        points.clear() ;
+        for( uint32_t t: triangles ) {
+            for( size_t k=0 ; k<3 ; k++ ) {
+                uint32_t v = indices_[3*t + k] ;
+                if ( stamp_[v] == current_stamp_ ) continue ;
+                stamp_[v] = current_stamp_ ;
+                points.push_back(vertices_[v]) ;
+            }
+        }
+    }
+
+    void computeHull(const vector<uint32_t> &triangles, Hull &hull) {
+        collectPoints(triangles, points_) ;
+        compute_hull(points_, hull) ;
+    }
+
+    // deepest vertex of the part below the hull surface
+    float concavity(const Part &part) {
+        if ( part.hull_.planes_.empty() ) return 0 ;
+
+        collectPoints(part.triangles_, points_) ;
+
+        float max_depth = 0 ;
+        for( const Vector3f &p: points_ ) {
+            float depth = numeric_limits<float>::max() ;
+            for( const Vector4f &pl: part.hull_.planes_ )
+                depth = std::min(depth, pl.w() - pl.head<3>().dot(p)) ;
+            max_depth = std::max(max_depth, depth) ;
+        }
+
+        return max_depth ;
+    }
+
+    void evaluate(Part &part) {
+        computeHull(part.triangles_, part.hull_) ;
+        part.concavity_ = concavity(part) ;
+    }
+
+    // try planes at regular intervals along each axis and keep the one with the least total hull volume
+    bool split(const Part &part, Part &left, Part &right) {
+        const size_t n_candidates = 7 ;
+
+        Vector3f bmin = Vector3f::Constant(numeric_limits<float>::max()), bmax = -bmin ;
+        for( uint32_t t: part.triangles_ ) {
+            bmin = bmin.cwiseMin(centroids_[t]) ;
+            bmax = bmax.cwiseMax(centroids_[t]) ;
+        }
+
+        float best_volume = numeric_limits<float>::max() ;
+        int best_axis = -1 ;
+        float best_pos = 0 ;
+
+        vector<uint32_t> lt, rt ;
+        Hull lh, rh ;
+
+        for( int axis=0 ; axis<3 ; axis++ ) {
+            if ( bmax[axis] - bmin[axis] <= 0 ) continue ;
+
+            for( size_t k=1 ; k<=n_candidates ; k++ ) {
+                float pos = bmin[axis] + ( bmax[axis] - bmin[axis] ) * k/( n_candidates + 1 ) ;
+
+                partition(part.triangles_, axis, pos, lt, rt) ;
+                if ( lt.empty() || rt.empty() ) continue ;
+
+                computeHull(lt, lh) ;
+                computeHull(rt, rh) ;
+
+                float volume = lh.volume_ + rh.volume_ ;
+                if ( volume < best_volume ) {
+                    best_volume = volume ;
+                    best_axis = axis ;
+                    best_pos = pos ;
+                }
+            }
+        }
+
+        if ( best_axis < 0 ) return false ;
+
+        partition(part.triangles_, best_axis, best_pos, left.triangles_, right.triangles_) ;
+        evaluate(left) ;
+        evaluate(right) ;
+
+        return true ;
+    }
+
+    static void compute_hull(const vector<Vector3f> &points, Hull &hull) ;
+
+private:
+
+    void partition(const vector<uint32_t> &triangles, int axis, float pos, vector<uint32_t> &lt, vector<uint32_t> &rt) const {
+        lt.clear() ; rt.clear() ;
+        for( uint32_t t: triangles ) {
+            if ( centroids_[t][axis] < pos ) lt.push_back(t) ;
+            else rt.push_back(t) ;
+        }
+    }
+
+    const vector<Vector3f> &vertices_ ;
+    const vector<uint32_t> &indices_ ;
+    vector<Vector3f> centroids_, points_ ;
+    vector<uint32_t> stamp_ ;
+    uint32_t current_stamp_ = 0 ;
+};
+
+void Decomposition::compute_hull(const vector<Vector3f> &points, Hull &hull) {
+
+    hull.vertices_.clear() ;
+    hull.planes_.clear() ;
+    hull.volume_ = 0 ;
+
+    if ( points.size() < 4 ) {
+        hull.vertices_ = points ;
+        return ;
+    }
+
+    btConvexHullComputer hc ;
+    hc.compute(points[0].data(), sizeof(Vector3f), points.size(), 0, 0) ;
+
+    Vector3f c = Vector3f::Zero() ;
+    for( int i=0 ; i<hc.vertices.size() ; i++ ) {
+        const btVector3 &v = hc.vertices[i] ;
+        hull.vertices_.emplace_back(v.x(), v.y(), v.z()) ;
+        c += hull.vertices_.back() ;
+    }
+
+    if ( hull.vertices_.empty() ) return ;
+    c /= hull.vertices_.size() ;
+
+    vector<int> poly ;
+
+    for( int f=0 ; f<hc.faces.size() ; f++ ) {
+        const btConvexHullComputer::Edge *start = &hc.edges[hc.faces[f]], *e = start ;
+
+        poly.clear() ;
+        do {
+            poly.push_back(e->getSourceVertex()) ;
+            e = e->getNextEdgeOfFace() ;
+        } while ( e != start ) ;
+
+        // Newell's method is robust to nearly collinear vertices, orientation is fixed using the hull centroid
+
+        Vector3f n = Vector3f::Zero() ;
+        for( size_t i=0 ; i<poly.size() ; i++ ) {
+            const Vector3f &a = hull.vertices_[poly[i]], &b = hull.vertices_[poly[(i+1) % poly.size()]] ;
+            n += Vector3f((a.y() - b.y()) * (a.z() + b.z()), (a.z() - b.z()) * (a.x() + b.x()), (a.x() - b.x()) * (a.y() + b.y())) ;
+        }
+
+        float l = n.norm() ;
+        if ( l == 0 ) continue ;
+        n /= l ;
+
+        const Vector3f &v0 = hull.vertices_[poly[0]] ;
+        float d = n.dot(v0) ;
+        if ( n.dot(c) > d ) { n = -n ; d = -d ; }
+
+        hull.planes_.emplace_back(n.x(), n.y(), n.z(), d) ;
+
+        for( size_t k=1 ; k+1<poly.size() ; k++ ) {
+            const Vector3f &v1 = hull.vertices_[poly[k]], &v2 = hull.vertices_[poly[k+1]] ;
+            hull.volume_ += fabs(( v0 - c ).dot(( v1 - c ).cross(v2 - c)))/6.f ;
+        }
+    }
+}
+
+// keep the support vertices in max_vertices directions evenly distributed on the sphere
+void reduce_hull(vector<Vector3f> &vertices, size_t max_vertices) {
+    if ( max_vertices == 0 || vertices.size() <= max_vertices ) return ;
+
+    vector<bool> selected(vertices.size(), false) ;
+    const float golden_angle = M_PI * ( 3.f - sqrt(5.f) ) ;
+
+    for( size_t i=0 ; i<max_vertices ; i++ ) {
+        float z = 1.f - 2.f * ( i + 0.5f )/max_vertices ;
+        float r = sqrt(1.f - z * z), phi = golden_angle * i ;
+        Vector3f dir(r * cos(phi), r * sin(phi), z) ;
+
+        size_t best = 0 ;
+        for( size_t j=1 ; j<vertices.size() ; j++ )
+            if ( vertices[j].dot(dir) > vertices[best].dot(dir) ) best = j ;
+
+        selected[best] = true ;
+    }
+
+    vector<Vector3f> reduced ;
+    for( size_t j=0 ; j<vertices.size() ; j++ )
+        if ( selected[j] ) reduced.push_back(vertices[j]) ;
+
+    vertices.swap(reduced) ;
+}
+
+}
+
+vector<vector<Vector3f>> convex_decomposition(const Mesh &mesh, const ConvexDecompositionParams &params) {
+
+    vector<vector<Vector3f>> result ;
+
+    if ( mesh.vertices_.empty() ) return result ;
+
+    if ( mesh.ptype_ != Mesh::Triangles || mesh.vertex_indices_.size() < 3 ) {
+        Hull hull ;
+        Decomposition::compute_hull(mesh.vertices_, hull) ;
+        reduce_hull(hull.vertices_, params.max_part_vertices_) ;
+        result.push_back(std::move(hull.vertices_)) ;
+        return result ;
+    }
+
+    Decomposition decomp(mesh) ;
+
+    Vector3f bmin = Vector3f::Constant(numeric_limits<float>::max()), bmax = -bmin ;
+    for( const Vector3f &v: mesh.vertices_ ) {
+        bmin = bmin.cwiseMin(v) ;
+        bmax = bmax.cwiseMax(v) ;
+    }
+
+    float tolerance = params.concavity_ * ( bmax - bmin ).norm() ;
+
+    vector<Part> parts(1) ;
+    for( uint32_t t=0 ; t<mesh.vertex_indices_.size()/3 ; t++ )
+        parts[0].triangles_.push_back(t) ;
+    decomp.evaluate(parts[0]) ;
+
+    while ( parts.size() < std::max<size_t>(params.max_parts_, 1) ) {
+
+        size_t worst = 0 ;
+        for( size_t i=1 ; i<parts.size() ; i++ )
+            if ( parts[i].concavity_ > parts[worst].concavity_ ) worst = i ;
+
+        if ( parts[worst].concavity_ <= tolerance ) break ;
+
+        Part left, right ;
+        if ( !decomp.split(parts[worst], left, right) ) {
+            parts[worst].concavity_ = 0 ;
+            continue ;
+        }
+
+        parts[worst] = std::move(left) ;
+        parts.push_back(std::move(right)) ;
+    }
+
+    for( Part &part: parts ) {
+        if ( part.hull_.vertices_.empty() ) continue ;
+        reduce_hull(part.hull_.vertices_, params.max_part_vertices_) ;
+        result.push_back(std::move(part.hull_.vertices_)) ;
+    }
+
+    return result ;
+}
+
+}}
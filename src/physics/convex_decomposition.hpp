@@ -0,0 +1,22 @@
+#ifndef __VSIM_PHYSICS_CONVEX_DECOMPOSITION_HPP__
+#define __VSIM_PHYSICS_CONVEX_DECOMPOSITION_HPP__
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include <vsim/env/geometry.hpp>
+#include <vsim/physics/world.hpp>
+
+namespace vsim { namespace physics {
+
+// Approximate convex decomposition of a triangle mesh. Starting from the whole mesh, the part with the largest concavity
+// (depth of its vertices below the surface of its convex hull) is repeatedly split by the axis aligned plane that minimizes
+// the total volume of the hulls of the two halves, until all parts are within tolerance or the maximum number of parts is reached.
+// Returns the hull vertices of each part.
+
+std::vector<std::vector<Eigen::Vector3f>> convex_decomposition(const Mesh &mesh, const ConvexDecompositionParams &params) ;
+
+}}
+
+#endif
@@ -0,0 +1,152 @@
+#include "world_impl.hpp"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+// Hinge angles of rigid bodies are measured by Bullet as the rotation of body a relative to body b about the axis of body a,
+// so the joint velocity and torque follow the same convention.
+
+static btVector3 hinge_axis(btHingeConstraint *hinge) {
+    return hinge->getRigidBodyA().getWorldTransform().getBasis() * hinge->getAFrame().getBasis().getColumn(2) ;
+}
+
+float WorldImpl::jointPosition(const Joint &j) const {
+    if ( j.mb_ ) return j.mb_->getJointPos(j.link_) ;
+    return j.hinge_->getHingeAngle() ;
+}
+
+float WorldImpl::jointVelocity(const Joint &j) const {
+    if ( j.mb_ ) return j.mb_->getJointVel(j.link_) ;
+
+    const btRigidBody &a = j.hinge_->getRigidBodyA(), &b = j.hinge_->getRigidBodyB() ;
+    return ( a.getAngularVelocity() - b.getAngularVelocity() ).dot(hinge_axis(j.hinge_)) ;
+}
+
+void WorldImpl::addJointTorque(const Joint &j, float t) {
+    if ( j.mb_ ) {
+        j.mb_->wakeUp() ;
+        j.mb_->addJointTorque(j.link_, t) ;
+        return ;
+    }
+
+    btVector3 torque = hinge_axis(j.hinge_) * t ;
+    btRigidBody &a = j.hinge_->getRigidBodyA(), &b = j.hinge_->getRigidBodyB() ;
+
+    a.activate() ;
+    a.applyTorque(torque) ;
+
+    if ( !b.isStaticOrKinematicObject() ) {
+        b.activate() ;
+        b.applyTorque(-torque) ;
+    }
+}
+
+int WorldImpl::findJoint(const string &id) const {
+    auto it = joint_index_.find(id) ;
+    if ( it == joint_index_.end() ) return -1 ;
+    return it->second ;
+}
+
+void WorldImpl::getJointPositions(float *q) const {
+    for( const Joint &j: joints_ )
+        *q++ = jointPosition(j) ;
+}
+
+void WorldImpl::getJointVelocities(float *qd) const {
+    for( const Joint &j: joints_ )
+        *qd++ = jointVelocity(j) ;
+}
+
+void WorldImpl::setJointTorques(const float *tau) {
+    for( const Joint &j: joints_ ) {
+        float t = *tau++ ;
+        if ( t != 0 ) addJointTorque(j, t) ;
+    }
+}
+
+void WorldImpl::setJointGains(const float *kp, const float *kd) {
+
+    size_t n = joints_.size() ;
+    joint_control_.resize(n) ;
+
+    joint_control_enabled_ = false ;
+
+    for( size_t i=0 ; i<n ; i++ ) {
+        JointControl &c = joint_control_[i] ;
+        c.kp_ = kp ? kp[i] : 0.f ;
+        c.kd_ = kd ? kd[i] : 0.f ;
+        joint_control_enabled_ = joint_control_enabled_ || c.kp_ != 0 || c.kd_ != 0 ;
+    }
+}
+
+void WorldImpl::setJointTargets(const float *q, const float *qd) {
+
+    joint_control_.resize(joints_.size()) ;
+
+    for( size_t i=0 ; i<joint_control_.size() ; i++ ) {
+        if ( q ) joint_control_[i].q_target_ = q[i] ;
+        if ( qd ) joint_control_[i].qd_target_ = qd[i] ;
+    }
+}
+
+void WorldImpl::setJointTorqueLimits(const float *max_torque) {
+
+    joint_control_.resize(joints_.size()) ;
+
+    for( size_t i=0 ; i<joint_control_.size() ; i++ )
+        joint_control_[i].max_torque_ = max_torque ? max_torque[i] : numeric_limits<float>::infinity() ;
+}
+
+// Bullet accumulates forces over all internal steps of stepSimulation, so a torque applied before an internal step would
+// also act in the following ones. Rigid bodies receive the torque over the step as an impulse instead, which the solver
+// treats the same way; multibody joint torques are subtracted again after the step.
+
+void WorldImpl::updateJointControllers(float h) {
+
+    for( size_t i=0 ; i<joints_.size() ; i++ ) {
+        const Joint &j = joints_[i] ;
+        JointControl &c = joint_control_[i] ;
+
+        c.applied_ = 0 ;
+        if ( c.kp_ == 0 && c.kd_ == 0 ) continue ;
+
+        float t = c.kp_ * ( c.q_target_ - jointPosition(j) ) + c.kd_ * ( c.qd_target_ - jointVelocity(j) ) ;
+        t = std::max(-c.max_torque_, std::min(t, c.max_torque_)) ;
+
+        if ( t == 0 ) continue ;
+
+        if ( j.mb_ ) {
+            j.mb_->wakeUp() ;
+            j.mb_->addJointTorque(j.link_, t) ;
+            c.applied_ = t ;
+        } else {
+            btVector3 impulse = hinge_axis(j.hinge_) * ( t * h ) ;
+            btRigidBody &a = j.hinge_->getRigidBodyA(), &b = j.hinge_->getRigidBodyB() ;
+
+            a.activate() ;
+            a.applyTorqueImpulse(impulse) ;
+
+            if ( !b.isStaticOrKinematicObject() ) {
+                b.activate() ;
+                b.applyTorqueImpulse(-impulse) ;
+            }
+        }
+    }
+}
+
+void WorldImpl::removeJointControllerTorques() {
+
+    for( size_t i=0 ; i<joints_.size() ; i++ ) {
+        JointControl &c = joint_control_[i] ;
+        if ( c.applied_ == 0 ) continue ;
+
+        joints_[i].mb_->addJointTorque(joints_[i].link_, -c.applied_) ;
+        c.applied_ = 0 ;
+    }
+}
+
+}}
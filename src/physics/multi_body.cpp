@@ -0,0 +1,211 @@
+#include "world_impl.hpp"
+#include "bullet_tools.hpp"
+
+#include <BulletDynamics/Featherstone/btMultiBodyJointLimitConstraint.h>
+
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/rigid_body_constraint.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <cmath>
+#include <tuple>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+// The model must be a tree of hinges. The first body of the model becomes the base (fixed if it is static) and the other
+// bodies become links in breadth first order, so that each link comes after its parent as Bullet requires. The frame of
+// each link is the frame of its body and the joint angles are zero at the initial poses.
+
+void WorldImpl::createMultiBody(const PhysicsModelPtr &model) {
+
+    const vector<RigidBodyPtr> &bodies = model->bodies_ ;
+    size_t n = bodies.size() ;
+
+    map<const RigidBody *, size_t> local_index ;
+    for( size_t i=0 ; i<n ; i++ )
+        local_index[bodies[i].get()] = i ;
+
+    struct Edge {
+        size_t other_ ;
+        const HingeConstraint *hinge_ ;
+        bool other_is_b_ ;  // the other body is body b_ of the hinge
+    };
+
+    vector<vector<Edge>> adjacent(n) ;
+
+    for( const RigidBodyConstraintPtr &c: model->constraints_ ) {
+        const HingeConstraint *hc = dynamic_cast<const HingeConstraint *>(c.get()) ;
+        if ( !hc )
+            throw PhysicsException(util::format("unsupported type of constraint \"%\" in multibody \"%\"", c->id_, model->id_)) ;
+
+        auto ia = local_index.find(c->a_.get()), ib = local_index.find(c->b_.get()) ;
+        if ( ia == local_index.end() || ib == local_index.end() )
+            throw PhysicsException(util::format("constraint \"%\" of multibody \"%\" should link two bodies of the model", c->id_, model->id_)) ;
+
+        adjacent[ia->second].push_back({ib->second, hc, true}) ;
+        adjacent[ib->second].push_back({ia->second, hc, false}) ;
+    }
+
+    vector<int> link(n, -2) ;
+    vector<size_t> order, parent(n) ;
+    vector<const Edge *> joint(n, nullptr) ;
+
+    link[0] = -1 ;
+    order.push_back(0) ;
+
+    for( size_t k=0 ; k<order.size() ; k++ ) {
+        for( const Edge &e: adjacent[order[k]] ) {
+            if ( link[e.other_] != -2 ) continue ;
+            link[e.other_] = order.size() - 1 ;
+            parent[e.other_] = order[k] ;
+            joint[e.other_] = &e ;
+            order.push_back(e.other_) ;
+        }
+    }
+
+    if ( order.size() != n || model->constraints_.size() != n - 1 )
+        throw PhysicsException(util::format("the bodies of multibody \"%\" should form a tree of hinges", model->id_)) ;
+
+    vector<btTransform> transforms(n) ;
+    for( size_t i=0 ; i<n ; i++ )
+        transforms[i] = toBullet(Affine3f(bodies[i]->pose_.absolute())) ;
+
+    const RigidBody *root = bodies[0].get() ;
+    bool fixed_base = root->isStatic() ;
+
+    btVector3 base_inertia(0, 0, 0) ;
+    if ( !fixed_base )
+        shapes_->find(root)->calculateLocalInertia(root->mass_, base_inertia) ;
+
+    btMultiBody *mb = new btMultiBody(n - 1, fixed_base ? 0 : root->mass_, base_inertia, fixed_base, true) ;
+    multi_bodies_.emplace_back(mb) ;
+
+    mb->setBasePos(transforms[0].getOrigin()) ;
+    mb->setWorldToBaseRot(transforms[0].getRotation().inverse()) ;
+    mb->setBaseVel(toBullet(root->velocity_)) ;
+    mb->setBaseOmega(toBullet(root->angular_velocity_)) ;
+
+    size_t first_joint = joints_.size() ;
+
+    // joint limits as (link, lower, upper), the constraints can only be created once the multibody is finalized
+    vector<tuple<int, float, float>> limits ;
+
+    for( size_t k=1 ; k<n ; k++ ) {
+        size_t c = order[k], p = parent[c] ;
+        const RigidBody *body = bodies[c].get() ;
+        const Edge &e = *joint[c] ;
+        const HingeConstraint *hc = e.hinge_ ;
+
+        if ( body->isStatic() )
+            throw PhysicsException(util::format("link \"%\" of multibody \"%\" should have positive mass", body->id_, model->id_)) ;
+
+        btVector3 inertia(0, 0, 0) ;
+        shapes_->find(body)->calculateLocalInertia(body->mass_, inertia) ;
+
+        const Vector3f &pivot_parent = e.other_is_b_ ? hc->pivot_a_ : hc->pivot_b_ ;
+        const Vector3f &pivot_child = e.other_is_b_ ? hc->pivot_b_ : hc->pivot_a_ ;
+        const Vector3f &axis_child = e.other_is_b_ ? hc->axis_b_ : hc->axis_a_ ;
+
+        // rotates vectors from the parent frame to the link frame
+        btQuaternion parent_to_link = transforms[c].getRotation().inverse() * transforms[p].getRotation() ;
+
+        // linked bodies do not collide with each other
+        mb->setupRevolute(link[c], body->mass_, inertia, link[p], parent_to_link, toBullet(axis_child).normalized(),
+                          toBullet(pivot_parent), -toBullet(pivot_child), true) ;
+
+        // the angle is measured the other way around if the child is body a_ of the hinge
+        float lower = e.other_is_b_ ? hc->min_angle_ : -hc->max_angle_ ;
+        float upper = e.other_is_b_ ? hc->max_angle_ : -hc->min_angle_ ;
+
+        if ( lower <= upper && upper - lower < 2 * M_PI )
+            limits.emplace_back(link[c], lower, upper) ;
+
+        if ( !hc->id_.empty() )
+            joint_index_[hc->id_] = first_joint + link[c] ;
+    }
+
+    mb->finalizeMultiDof() ;
+    multi_body_world_->addMultiBody(mb) ;
+
+    for( size_t k=1 ; k<n ; k++ )
+        joints_.push_back({mb, (int)k - 1, nullptr}) ;
+
+    for( const auto &l: limits ) {
+        btMultiBodyConstraint *c = new btMultiBodyJointLimitConstraint(mb, get<0>(l), get<1>(l), get<2>(l)) ;
+        multi_body_constraints_.emplace_back(c) ;
+        multi_body_world_->addMultiBodyConstraint(c) ;
+    }
+
+    // colliders and body table entries in the order of the model bodies
+
+    vector<size_t> links(n) ;
+
+    for( size_t i=0 ; i<n ; i++ ) {
+        const RigidBodyPtr &body = bodies[i] ;
+
+        btMultiBodyLinkCollider *col = new btMultiBodyLinkCollider(mb, link[i]) ;
+        link_colliders_.emplace_back(col) ;
+
+        col->setCollisionShape(shapes_->find(body.get())) ;
+        col->setWorldTransform(transforms[i]) ;
+        col->setUserIndex(bodies_.size()) ;
+
+        int group, mask ;
+        ShapeLibrary::collisionFilter(*body, fixed_base && link[i] < 0, group, mask) ;
+        dynamics_world_->addCollisionObject(col, group, mask) ;
+
+        if ( link[i] < 0 ) mb->setBaseCollider(col) ;
+        else mb->getLink(link[i]).m_collider = col ;
+
+        if ( !body->id_.empty() )
+            body_index_[body->id_] = bodies_.size() ;
+
+        links[link[i] + 1] = bodies_.size() ;
+        body_map_[body.get()] = bodies_.size() ;
+        bodies_.push_back({nullptr, col, body.get(), mb, link[i], true}) ;
+    }
+
+    multi_body_links_.push_back(std::move(links)) ;
+}
+
+void WorldImpl::updateLinkVelocities() {
+
+    // velocities are propagated from parents to children, each link rotates about its joint axis relative to its parent
+
+    for( size_t m=0 ; m<multi_bodies_.size() ; m++ ) {
+        const btMultiBody *mb = multi_bodies_[m].get() ;
+        const vector<size_t> &links = multi_body_links_[m] ;
+
+        link_linear_velocities_[links[0]] = mb->getBaseVel() ;
+        link_angular_velocities_[links[0]] = mb->getBaseOmega() ;
+
+        for( int l=0 ; l<mb->getNumLinks() ; l++ ) {
+            size_t c = links[l + 1], p = links[mb->getParent(l) + 1] ;
+            const btTransform &tc = bodies_[c].co_->getWorldTransform(), &tp = bodies_[p].co_->getWorldTransform() ;
+            const btMultibodyLink &link = mb->getLink(l) ;
+
+            btVector3 pivot = tp * link.m_eVector ;
+            btVector3 w = link_angular_velocities_[p] + tc.getBasis() * link.getAxisTop(0) * mb->getJointVel(l) ;
+
+            link_linear_velocities_[c] = link_linear_velocities_[p] + link_angular_velocities_[p].cross(pivot - tp.getOrigin())
+                    + w.cross(tc.getOrigin() - pivot) ;
+            link_angular_velocities_[c] = w ;
+        }
+    }
+}
+
+void WorldImpl::updateMultiBodies() {
+    for( auto &mb: multi_bodies_ ) {
+        mb->forwardKinematics(scratch_rotations_, scratch_positions_) ;
+        mb->updateCollisionObjectWorldTransforms(scratch_rotations_, scratch_positions_) ;
+    }
+
+    updateLinkVelocities() ;
+}
+
+}}
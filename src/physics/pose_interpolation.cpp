@@ -0,0 +1,56 @@
+#include <vsim/physics/pose_interpolation.hpp>
+
+#include <cmath>
+
+namespace vsim { namespace physics {
+
+// The loops have no branches or calls to math functions with error handling and each component is a separate restrict
+// qualified array, so that they are vectorized.
+
+static void lerp(size_t n, const float *__restrict a, const float *__restrict b, float t, float *__restrict o) {
+    for( size_t i=0 ; i<n ; i++ )
+        o[i] = a[i] + t * ( b[i] - a[i] ) ;
+}
+
+// Approximation of slerp by A. Kapoulkine (https://zeux.io/2015/07/23/approximating-slerp/): the interpolation parameter
+// is corrected by a polynomial in t and in the cosine of the angle between the quaternions, the result is normalized by
+// Newton iterations for the inverse square root starting from the squared norm, which is in [0.5, 1] along the shortest arc.
+
+static void nlerp(size_t n, const float *__restrict ax, const float *__restrict ay, const float *__restrict az, const float *__restrict aw,
+                  const float *__restrict bx, const float *__restrict by, const float *__restrict bz, const float *__restrict bw,
+                  float t, float *__restrict ox, float *__restrict oy, float *__restrict oz, float *__restrict ow) {
+
+    for( size_t i=0 ; i<n ; i++ ) {
+        float d = ax[i] * bx[i] + ay[i] * by[i] + az[i] * bz[i] + aw[i] * bw[i] ;
+        float c = std::fabs(d) ;
+
+        float ka = 1.0904f + c * ( -3.2452f + c * ( 3.55645f - c * 1.43519f ) ) ;
+        float kb = 0.848013f + c * ( -1.06021f + c * 0.215638f ) ;
+        float k = ka * ( t - 0.5f ) * ( t - 0.5f ) + kb ;
+        float s = t + t * ( t - 0.5f ) * ( t - 1.f ) * k ;
+
+        // q and -q are the same rotation, take the one closer to a
+        float wa = 1.f - s, wb = std::copysign(s, d) ;
+
+        float x = wa * ax[i] + wb * bx[i], y = wa * ay[i] + wb * by[i], z = wa * az[i] + wb * bz[i], w = wa * aw[i] + wb * bw[i] ;
+        float norm2 = x * x + y * y + z * z + w * w ;
+
+        float r = 1.5f - 0.5f * norm2 ;
+        r *= 1.5f - 0.5f * norm2 * r * r ;
+        r *= 1.5f - 0.5f * norm2 * r * r ;
+        r *= 1.5f - 0.5f * norm2 * r * r ;
+
+        ox[i] = x * r ; oy[i] = y * r ; oz[i] = z * r ; ow[i] = w * r ;
+    }
+}
+
+void interpolatePoses(size_t n, const float *from, const float *to, float t, float *out) {
+
+    for( size_t k=0 ; k<3 ; k++ )
+        lerp(n, from + k*n, to + k*n, t, out + k*n) ;
+
+    nlerp(n, from + 3*n, from + 4*n, from + 5*n, from + 6*n, to + 3*n, to + 4*n, to + 5*n, to + 6*n,
+          t, out + 3*n, out + 4*n, out + 5*n, out + 6*n) ;
+}
+
+}}
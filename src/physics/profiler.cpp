@@ -0,0 +1,236 @@
+#include <vsim/physics/profiler.hpp>
+#include <vsim/physics/world.hpp>
+
+#include "world_impl.hpp"
+
+#include <vsim/util/format.hpp>
+
+#include <LinearMath/btQuickprof.h>
+
+#include <fstream>
+#include <cstring>
+#include <mutex>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+StepProfiler::StepProfiler(size_t capacity): buffer_(std::max<size_t>(capacity, 1)) {
+}
+
+void StepProfiler::push(const StepProfile &profile) {
+    if ( size_ == buffer_.size() ) {
+        buffer_[head_] = profile ;
+        head_ = ( head_ + 1 ) % buffer_.size() ;
+    } else {
+        buffer_[( head_ + size_ ) % buffer_.size()] = profile ;
+        ++size_ ;
+    }
+}
+
+void StepProfiler::clear() {
+    head_ = size_ = 0 ;
+}
+
+StepProfile StepProfiler::average() const {
+    StepProfile a = StepProfile() ;
+    if ( size_ == 0 ) return a ;
+
+    double sub_steps = 0, pairs = 0, manifolds = 0, contacts = 0, iterations = 0 ;
+
+    for( size_t i=0 ; i<size_ ; i++ ) {
+        const StepProfile &p = (*this)[i] ;
+        a.total_ += p.total_ ;
+        a.broadphase_ += p.broadphase_ ;
+        a.narrowphase_ += p.narrowphase_ ;
+        a.solver_ += p.solver_ ;
+        a.integration_ += p.integration_ ;
+        a.sync_ += p.sync_ ;
+        sub_steps += p.n_sub_steps_ ;
+        pairs += p.n_pairs_ ;
+        manifolds += p.n_manifolds_ ;
+        contacts += p.n_contacts_ ;
+        iterations += p.n_solver_iterations_ ;
+    }
+
+    a.time_ = last().time_ ;
+    a.total_ /= size_ ; a.broadphase_ /= size_ ; a.narrowphase_ /= size_ ; a.solver_ /= size_ ; a.integration_ /= size_ ; a.sync_ /= size_ ;
+    a.n_sub_steps_ = sub_steps/size_ + 0.5 ;
+    a.n_pairs_ = pairs/size_ + 0.5 ;
+    a.n_manifolds_ = manifolds/size_ + 0.5 ;
+    a.n_contacts_ = contacts/size_ + 0.5 ;
+    a.n_solver_iterations_ = iterations/size_ + 0.5 ;
+
+    return a ;
+}
+
+void StepProfiler::writeCSV(ostream &strm) const {
+    strm << "time,total_ms,broadphase_ms,narrowphase_ms,solver_ms,integration_ms,sync_ms,sub_steps,pairs,manifolds,contacts,solver_iterations\n" ;
+
+    for( size_t i=0 ; i<size_ ; i++ ) {
+        const StepProfile &p = (*this)[i] ;
+        strm << p.time_ << ',' << p.total_ * 1000 << ',' << p.broadphase_ * 1000 << ',' << p.narrowphase_ * 1000 << ','
+             << p.solver_ * 1000 << ',' << p.integration_ * 1000 << ',' << p.sync_ * 1000 << ',' << p.n_sub_steps_ << ','
+             << p.n_pairs_ << ',' << p.n_manifolds_ << ',' << p.n_contacts_ << ',' << p.n_solver_iterations_ << '\n' ;
+    }
+}
+
+void StepProfiler::writeCSV(const string &fname) const {
+    ofstream strm(fname) ;
+    if ( !strm )
+        throw PhysicsException(util::format("cannot write profile to \"%\"", fname)) ;
+
+    writeCSV(strm) ;
+}
+
+// Bullet reports its profiling zones (BT_PROFILE) through global enter and leave hooks. The hooks do nothing unless a
+// world that profiles is stepping on the calling thread; zones entered by worker threads of the multithreaded world are
+// nested in zones of the stepping thread and are not counted separately.
+
+namespace {
+
+typedef chrono::steady_clock profile_clock ;
+
+enum Phase { NO_PHASE = -1, BROADPHASE, NARROWPHASE, SOLVER, INTEGRATION } ;
+
+struct ThreadProfile {
+    StepProfile *sink_ = nullptr ;
+    int depth_ = 0 ;
+    int open_phase_depth_ = -1 ;   // depth of the zone that is being timed, phases nested in it are ignored
+    Phase phase_ ;
+    profile_clock::time_point start_ ;
+
+    // zone names are literals so phases are cached by address
+    static const int CACHE_SIZE = 64 ;
+    const char *cached_names_[CACHE_SIZE] ;
+    Phase cached_phases_[CACHE_SIZE] ;
+    int n_cached_ = 0 ;
+};
+
+thread_local ThreadProfile thread_profile ;
+
+Phase classify_zone(const char *name) {
+    static const pair<const char *, Phase> phases[] = {
+        { "updateAabbs", BROADPHASE },
+        { "calculateOverlappingPairs", BROADPHASE },
+        { "dispatchAllCollisionPairs", NARROWPHASE },
+        { "createPredictiveContacts", NARROWPHASE },
+        { "solveConstraints", SOLVER },
+        { "predictUnconstraintMotion", INTEGRATION },
+        { "integrateTransforms", INTEGRATION }
+    } ;
+
+    for( const auto &p: phases )
+        if ( strstr(name, p.first) ) return p.second ;
+
+    return NO_PHASE ;
+}
+
+Phase zone_phase(ThreadProfile &tp, const char *name) {
+    for( int i=0 ; i<tp.n_cached_ ; i++ )
+        if ( tp.cached_names_[i] == name ) return tp.cached_phases_[i] ;
+
+    Phase phase = classify_zone(name) ;
+
+    if ( tp.n_cached_ < ThreadProfile::CACHE_SIZE ) {
+        tp.cached_names_[tp.n_cached_] = name ;
+        tp.cached_phases_[tp.n_cached_++] = phase ;
+    }
+
+    return phase ;
+}
+
+void enter_zone(const char *name) {
+    ThreadProfile &tp = thread_profile ;
+    if ( !tp.sink_ ) return ;
+
+    if ( tp.open_phase_depth_ < 0 ) {
+        Phase phase = zone_phase(tp, name) ;
+        if ( phase != NO_PHASE ) {
+            tp.open_phase_depth_ = tp.depth_ ;
+            tp.phase_ = phase ;
+            tp.start_ = profile_clock::now() ;
+        }
+    }
+
+    ++tp.depth_ ;
+}
+
+void leave_zone() {
+    ThreadProfile &tp = thread_profile ;
+    if ( !tp.sink_ ) return ;
+
+    if ( --tp.depth_ != tp.open_phase_depth_ ) return ;
+
+    double elapsed = chrono::duration<double>(profile_clock::now() - tp.start_).count() ;
+    tp.open_phase_depth_ = -1 ;
+
+    switch ( tp.phase_ ) {
+    case BROADPHASE: tp.sink_->broadphase_ += elapsed ; break ;
+    case NARROWPHASE: tp.sink_->narrowphase_ += elapsed ; break ;
+    case SOLVER: tp.sink_->solver_ += elapsed ; break ;
+    case INTEGRATION: tp.sink_->integration_ += elapsed ; break ;
+    default: break ;
+    }
+}
+
+}
+
+StepProfiler &WorldImpl::enableProfiling(size_t capacity) {
+
+    // the hooks replace those of CProfileManager for the whole process, older versions of Bullet have no hooks so only
+    // the total and sync times and the counters are recorded
+#if BT_BULLET_VERSION >= 286
+    static once_flag hooks_installed ;
+    call_once(hooks_installed, [] {
+        btSetCustomEnterProfileZoneFunc(&enter_zone) ;
+        btSetCustomLeaveProfileZoneFunc(&leave_zone) ;
+    }) ;
+#endif
+
+    profiler_.reset(new StepProfiler(capacity)) ;
+    return *profiler_ ;
+}
+
+void WorldImpl::disableProfiling() {
+    profiler_.reset() ;
+}
+
+void WorldImpl::beginProfile() {
+    profile_ = StepProfile() ;
+    profile_start_ = profile_clock::now() ;
+
+    ThreadProfile &tp = thread_profile ;
+    tp.sink_ = &profile_ ;
+    tp.depth_ = 0 ;
+    tp.open_phase_depth_ = -1 ;
+}
+
+void WorldImpl::endSimulationProfile() {
+    thread_profile.sink_ = nullptr ;
+    profile_simulated_ = profile_clock::now() ;
+}
+
+void WorldImpl::endProfile() {
+
+    auto end = profile_clock::now() ;
+
+    profile_.time_ = time_ ;
+    profile_.total_ = chrono::duration<double>(end - profile_start_).count() ;
+    profile_.sync_ = chrono::duration<double>(end - profile_simulated_).count() ;
+    profile_.n_sub_steps_ = n_sub_steps_ ;
+    profile_.n_pairs_ = broadphase_interface_->getOverlappingPairCache()->getNumOverlappingPairs() ;
+    profile_.n_solver_iterations_ = dynamics_world_->getSolverInfo().m_numIterations ;
+
+    btDispatcher *dispatcher = dynamics_world_->getDispatcher() ;
+    int n_manifolds = dispatcher->getNumManifolds() ;
+
+    profile_.n_manifolds_ = n_manifolds ;
+    profile_.n_contacts_ = 0 ;
+    for( int i=0 ; i<n_manifolds ; i++ )
+        profile_.n_contacts_ += dispatcher->getManifoldByIndexInternal(i)->getNumContacts() ;
+
+    profiler_->push(profile_) ;
+}
+
+}}
@@ -0,0 +1,201 @@
+#include "world_impl.hpp"
+
+#include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
+
+#include <vsim/util/thread_pool.hpp>
+
+#include <algorithm>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+namespace {
+
+// Tests a single ray against the leaves of the broadphase tree that it overlaps. This mirrors btCollisionWorld::rayTest but
+// uses caller supplied traversal stacks, since the one of btDbvtBroadphase is shared unless Bullet is built thread safe and
+// rayTestSingle allocates a new one for the tree of every compound shape. Older versions of Bullet have no traversal with an
+// external stack, the rays are then cast through the world.
+
+#if BT_BULLET_VERSION >= 288
+#define VSIM_RAY_TEST_STACK
+
+void ray_direction(const btVector3 &from, const btVector3 &to, btVector3 &inv_dir, unsigned int signs[3], btScalar &length) {
+    btVector3 dir = to - from ;
+    length = dir.length() ;
+    if ( length > 0 ) dir /= length ;
+
+    for( int k=0 ; k<3 ; k++ ) {
+        inv_dir[k] = ( dir[k] == btScalar(0) ) ? btScalar(BT_LARGE_FLOAT) : btScalar(1)/dir[k] ;
+        signs[k] = inv_dir[k] < 0 ;
+    }
+}
+#endif
+
+// rays hit all bodies, the collision groups and masks of the bodies only filter contacts between them
+struct ClosestRayCallback: public btCollisionWorld::ClosestRayResultCallback {
+    ClosestRayCallback(const btVector3 &from, const btVector3 &to): ClosestRayResultCallback(from, to) {}
+
+    bool needsCollision(btBroadphaseProxy *) const override { return true ; }
+};
+
+struct RayCollector: public btDbvt::ICollide {
+
+    RayCollector(const btVector3 &from, const btVector3 &to, btAlignedObjectArray<const btDbvtNode *> *compound_stack):
+        callback_(from, to), compound_stack_(compound_stack) {
+        from_.setIdentity() ; from_.setOrigin(from) ;
+        to_.setIdentity() ; to_.setOrigin(to) ;
+    }
+
+    void Process(const btDbvtNode *leaf) override {
+        btBroadphaseProxy *proxy = static_cast<btBroadphaseProxy *>(leaf->data) ;
+        if ( !callback_.needsCollision(proxy) ) return ;
+
+        btCollisionObject *obj = static_cast<btCollisionObject *>(proxy->m_clientObject) ;
+        const btCollisionShape *shape = obj->getCollisionShape() ;
+
+#ifdef VSIM_RAY_TEST_STACK
+        if ( shape->isCompound() ) {
+            rayTestCompound(obj, static_cast<const btCompoundShape *>(shape)) ;
+            return ;
+        }
+#endif
+
+        btCollisionWorld::rayTestSingle(from_, to_, obj, shape, obj->getWorldTransform(), callback_) ;
+    }
+
+#ifdef VSIM_RAY_TEST_STACK
+    // children of the compound whose bounds the ray crosses, found in the local frame of the compound
+    struct ChildCollector: public btDbvt::ICollide {
+        ChildCollector(RayCollector &ray, btCollisionObject *obj, const btCompoundShape *compound): ray_(ray), obj_(obj), compound_(compound) {}
+
+        void Process(const btDbvtNode *leaf) override {
+            ray_.rayTestChild(obj_, compound_, leaf->dataAsInt) ;
+        }
+
+        RayCollector &ray_ ;
+        btCollisionObject *obj_ ;
+        const btCompoundShape *compound_ ;
+    };
+
+    void rayTestCompound(btCollisionObject *obj, const btCompoundShape *compound) {
+        const btDbvt *tree = compound->getDynamicAabbTree() ;
+
+        if ( !tree || !tree->m_root ) {
+            for( int i=0 ; i<compound->getNumChildShapes() ; i++ )
+                rayTestChild(obj, compound, i) ;
+            return ;
+        }
+
+        btTransform inv = obj->getWorldTransform().inverse() ;
+        btVector3 from = inv * from_.getOrigin(), to = inv * to_.getOrigin() ;
+
+        btVector3 inv_dir, zero(0, 0, 0) ;
+        unsigned int signs[3] ;
+        btScalar length ;
+        ray_direction(from, to, inv_dir, signs, length) ;
+
+        ChildCollector children(*this, obj, compound) ;
+        tree->rayTestInternal(tree->m_root, from, to, inv_dir, signs, length, zero, zero, *compound_stack_, children) ;
+    }
+
+    // children are leaves since compounds of bodies are flattened by the shape library
+    void rayTestChild(btCollisionObject *obj, const btCompoundShape *compound, int i) {
+        btTransform tr = obj->getWorldTransform() * compound->getChildTransform(i) ;
+        btCollisionWorld::rayTestSingle(from_, to_, obj, compound->getChildShape(i), tr, callback_) ;
+    }
+#endif
+
+    btTransform from_, to_ ;
+    ClosestRayCallback callback_ ;
+    btAlignedObjectArray<const btDbvtNode *> *compound_stack_ ;
+};
+
+}
+
+void WorldImpl::rayCastBatch(size_t n, const float *origins, const float *directions, float max_dist,
+                             float *out_distances, float *out_normals, int *out_bodies) const {
+
+    util::ThreadPool &pool = util::ThreadPool::instance() ;
+
+#ifdef VSIM_RAY_TEST_STACK
+    const btDbvtBroadphase *broadphase = dynamic_cast<const btDbvtBroadphase *>(broadphase_interface_.get()) ;
+#else
+    const btDbvtBroadphase *broadphase = nullptr ;
+#endif
+
+    // the stacks are per world so concurrent batches on the same world are serialized
+    lock_guard<mutex> lock(ray_mutex_) ;
+
+    // a loop issued from a worker of another pool runs serially with the index of that worker, each thread has a stack for
+    // the broadphase tree and one for the trees of compound shapes
+    size_t n_stacks = std::max(pool.numThreads(), util::ThreadPool::threadIndex() + 1) ;
+    if ( ray_stacks_.size() < 2 * n_stacks )
+        ray_stacks_.resize(2 * n_stacks) ;
+
+    const float *ox = origins, *oy = origins + n, *oz = origins + 2*n ;
+    const float *dx = directions, *dy = directions + n, *dz = directions + 2*n ;
+
+    auto cast = [&](size_t i) {
+        btVector3 dir(dx[i], dy[i], dz[i]) ;
+        btScalar l = dir.length() ;
+
+        btVector3 from(ox[i], oy[i], oz[i]), to = from ;
+        if ( l > 0 ) {
+            dir /= l ;
+            to = from + dir * max_dist ;
+        }
+
+        size_t t = util::ThreadPool::threadIndex() ;
+        RayCollector collector(from, to, broadphase ? &ray_stacks_[2*t + 1] : nullptr) ;
+
+        if ( l > 0 ) {
+#ifdef VSIM_RAY_TEST_STACK
+            if ( broadphase ) {
+                btVector3 inv_dir, zero(0, 0, 0) ;
+                unsigned int signs[3] ;
+                btScalar length ;
+                ray_direction(from, to, inv_dir, signs, length) ;
+
+                // dynamic and static sets
+                for( int s=0 ; s<2 ; s++ ) {
+                    const btDbvt &tree = broadphase->m_sets[s] ;
+                    if ( tree.m_root )
+                        tree.rayTestInternal(tree.m_root, from, to, inv_dir, signs, length, zero, zero, ray_stacks_[2*t], collector) ;
+                }
+            } else
+#endif
+                dynamics_world_->rayTest(from, to, collector.callback_) ;
+        }
+
+        const btCollisionWorld::ClosestRayResultCallback &cb = collector.callback_ ;
+        bool hit = cb.hasHit() ;
+
+        out_distances[i] = hit ? cb.m_closestHitFraction * max_dist : max_dist ;
+
+        if ( out_normals ) {
+            btVector3 normal = hit ? cb.m_hitNormalWorld.normalized() : btVector3(0, 0, 0) ;
+            out_normals[i] = normal.x() ; out_normals[n + i] = normal.y() ; out_normals[2*n + i] = normal.z() ;
+        }
+
+        if ( out_bodies )
+            out_bodies[i] = hit ? cb.m_collisionObject->getUserIndex() : -1 ;
+    } ;
+
+    // other broadphases are queried through the world which is not thread safe
+    if ( !broadphase ) {
+        for( size_t i=0 ; i<n ; i++ ) cast(i) ;
+        return ;
+    }
+
+    const size_t chunk_size = 64 ;
+    size_t n_chunks = ( n + chunk_size - 1 )/chunk_size ;
+
+    pool.parallelFor(n_chunks, [&](size_t c) {
+        size_t end = std::min(n, ( c + 1 ) * chunk_size) ;
+        for( size_t i=c * chunk_size ; i<end ; i++ )
+            cast(i) ;
+    }) ;
+}
+
+}}
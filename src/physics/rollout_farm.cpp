@@ -0,0 +1,189 @@
+#include <vsim/physics/rollout_farm.hpp>
+#include <vsim/physics/world_batch.hpp>
+
+#include "world_impl.hpp"
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <exception>
+#include <new>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+// the rollout counter is alone in the first cache line of the shared mapping
+static const size_t SHARED_HEADER_SIZE = 64 ;
+
+RolloutFarm::RolloutFarm(const PhysicsScenePtr &scene, const WorldConfig &config, size_t n_workers):
+    scene_(scene), config_(config), shapes_(new ShapeLibrary(scene, config)) {
+
+    // the task scheduler threads of Bullet do not survive a fork
+    config_.multithreaded_ = false ;
+
+    n_workers_ = n_workers ? n_workers : std::max<size_t>(thread::hardware_concurrency(), 1) ;
+
+    n_bodies_ = scene_->bodies_.size() ;
+    for( const PhysicsModelPtr &m: scene_->models_ )
+        n_bodies_ += m->bodies_.size() ;
+}
+
+RolloutFarm::~RolloutFarm() {
+    releaseResults() ;
+}
+
+void RolloutFarm::releaseResults() {
+    if ( shared_ ) munmap(shared_, shared_size_) ;
+    shared_ = nullptr ;
+    shared_size_ = 0 ;
+    states_ = rewards_ = nullptr ;
+    n_rollouts_ = n_steps_ = 0 ;
+}
+
+const float *RolloutFarm::states(size_t rollout) const {
+    return states_ + rollout * n_steps_ * n_bodies_ * WorldBatch::STATE_SIZE ;
+}
+
+const float *RolloutFarm::rewards(size_t rollout) const {
+    return rewards_ + rollout * n_steps_ ;
+}
+
+void RolloutFarm::run(size_t n_rollouts, size_t n_steps, const Policy &policy, const Callback &on_done, float dt) {
+
+    releaseResults() ;
+
+    size_t n_states = n_rollouts * n_steps * n_bodies_ * WorldBatch::STATE_SIZE, n_rewards = n_rollouts * n_steps ;
+    size_t size = SHARED_HEADER_SIZE + ( n_states + n_rewards ) * sizeof(float) ;
+
+    // anonymous shared pages are inherited by the workers and only touched by the worker that runs each rollout
+    void *shared = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) ;
+    if ( shared == MAP_FAILED )
+        throw PhysicsException(util::format("cannot map % bytes of shared memory for the rollouts", size)) ;
+
+    shared_ = shared ;
+    shared_size_ = size ;
+    n_rollouts_ = n_rollouts ;
+    n_steps_ = n_steps ;
+    states_ = reinterpret_cast<float *>(static_cast<uint8_t *>(shared) + SHARED_HEADER_SIZE) ;
+    rewards_ = states_ + n_states ;
+
+    new (shared) atomic<size_t>(0) ;
+
+    if ( n_rollouts == 0 ) return ;
+
+    // workers write the index of each completed rollout to the pipe, writes of up to PIPE_BUF bytes are atomic
+    int fds[2] ;
+    if ( pipe(fds) != 0 )
+        throw PhysicsException(util::format("cannot create the rollout pipe: %", strerror(errno))) ;
+
+    size_t n_procs = std::min(n_workers_, n_rollouts) ;
+    vector<pid_t> workers ;
+    bool failed = false ;
+
+    for( size_t i=0 ; i<n_procs ; i++ ) {
+        pid_t pid = fork() ;
+
+        if ( pid == 0 ) {
+            close(fds[0]) ;
+            int status = work(policy, fds[1], dt) ;
+            // skip the destructors and exit handlers of the parent's objects
+            _exit(status) ;
+        } else if ( pid < 0 ) {
+            failed = true ;
+            break ;
+        }
+
+        workers.push_back(pid) ;
+    }
+
+    close(fds[1]) ;
+
+    // the pipe reaches end of file when all workers have exited
+
+    exception_ptr callback_error ;
+    uint32_t rollout ;
+    ssize_t n ;
+
+    while ( ( n = read(fds[0], &rollout, sizeof(rollout)) ) != 0 ) {
+        if ( n < 0 ) {
+            if ( errno == EINTR ) continue ;
+            failed = true ;
+            break ;
+        }
+
+        if ( !on_done || callback_error ) continue ;
+
+        try {
+            on_done(rollout) ;
+        } catch ( ... ) {
+            callback_error = current_exception() ;
+        }
+    }
+
+    close(fds[0]) ;
+
+    for( pid_t pid: workers ) {
+        int status ;
+        while ( waitpid(pid, &status, 0) < 0 && errno == EINTR ) ;
+        if ( !WIFEXITED(status) || WEXITSTATUS(status) != 0 ) failed = true ;
+    }
+
+    if ( failed )
+        throw PhysicsException("rollout worker failed") ;
+
+    if ( callback_error )
+        rethrow_exception(callback_error) ;
+}
+
+int RolloutFarm::work(const Policy &policy, int notify_fd, float dt) {
+
+    try {
+        WorldImpl world(scene_, config_, shapes_, false) ;
+        size_t initial = world.snapshot() ;
+
+        const size_t state_stride = n_bodies_ * WorldBatch::STATE_SIZE ;
+        vector<float> initial_state(state_stride), actions(n_bodies_ * WorldBatch::ACTION_SIZE) ;
+        world.getState(initial_state.data()) ;
+
+        atomic<size_t> &next = *static_cast<atomic<size_t> *>(shared_) ;
+
+        for( size_t r = next++ ; r < n_rollouts_ ; r = next++ ) {
+            world.restore(initial) ;
+
+            float *states = states_ + r * n_steps_ * state_stride ;
+            float *rewards = rewards_ + r * n_steps_ ;
+
+            for( size_t s=0 ; s<n_steps_ ; s++ ) {
+                const float *state = ( s == 0 ) ? initial_state.data() : states + ( s - 1 ) * state_stride ;
+
+                std::fill(actions.begin(), actions.end(), 0.f) ;
+                rewards[s] = policy(r, s, state, actions.data()) ;
+
+                world.applyActions(actions.data()) ;
+                world.step(dt) ;
+                world.getState(states + s * state_stride) ;
+            }
+
+            uint32_t idx = r ;
+            while ( write(notify_fd, &idx, sizeof(idx)) < 0 && errno == EINTR ) ;
+        }
+    } catch ( ... ) {
+        return 1 ;
+    }
+
+    return 0 ;
+}
+
+}}
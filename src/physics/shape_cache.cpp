@@ -0,0 +1,100 @@
+#include "shape_cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+#include <atomic>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+ShapeCache::ShapeCache(const string &dir): dir_(dir) {
+    if ( !dir_.empty() ) mkdir(dir_.c_str(), 0755) ;
+}
+
+bool ShapeCache::load(const string &name, string &data) const {
+
+    if ( !enabled() ) return false ;
+
+    ifstream strm(dir_ + '/' + name, ios::binary) ;
+    if ( !strm ) return false ;
+
+    ostringstream buf ;
+    buf << strm.rdbuf() ;
+    data = buf.str() ;
+
+    return true ;
+}
+
+void ShapeCache::store(const string &name, const string &data) const {
+
+    if ( !enabled() ) return ;
+
+    string fpath = dir_ + '/' + name ;
+    // unique per process and call since several threads may store the same entry
+    static std::atomic<unsigned> counter(0) ;
+    string tmp_path = fpath + ".tmp" + to_string(getpid()) + "_" + to_string(counter++) ;
+
+    {
+        ofstream strm(tmp_path, ios::binary) ;
+        if ( !strm ) return ;
+        strm.write(data.data(), data.size()) ;
+        if ( !strm ) {
+            strm.close() ;
+            std::remove(tmp_path.c_str()) ;
+            return ;
+        }
+    }
+
+    if ( std::rename(tmp_path.c_str(), fpath.c_str()) != 0 )
+        std::remove(tmp_path.c_str()) ;
+}
+
+void *ShapeCache::map(const string &name, size_t &size) const {
+
+    if ( !enabled() ) return nullptr ;
+
+    int fd = open((dir_ + '/' + name).c_str(), O_RDONLY) ;
+    if ( fd < 0 ) return nullptr ;
+
+    struct stat st ;
+    if ( fstat(fd, &st) < 0 || st.st_size == 0 ) {
+        close(fd) ;
+        return nullptr ;
+    }
+
+    size = st.st_size ;
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) ;
+    close(fd) ;
+
+    return ( data == MAP_FAILED ) ? nullptr : data ;
+}
+
+void ShapeCache::unmap(void *data, size_t size) {
+    munmap(data, size) ;
+}
+
+uint64_t ShapeCache::hash(const void *data, size_t size, uint64_t seed) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data) ;
+    uint64_t h = seed ;
+    for( size_t i=0 ; i<size ; i++ ) {
+        h ^= bytes[i] ;
+        h *= 1099511628211ULL ;
+    }
+    return h ;
+}
+
+string ShapeCache::entryName(const string &prefix, uint64_t hash) {
+    ostringstream strm ;
+    strm << prefix << '_' << hex << setw(16) << setfill('0') << hash << ".bin" ;
+    return strm.str() ;
+}
+
+}}
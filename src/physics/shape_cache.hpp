@@ -0,0 +1,44 @@
+#ifndef __VSIM_PHYSICS_SHAPE_CACHE_HPP__
+#define __VSIM_PHYSICS_SHAPE_CACHE_HPP__
+
+#include <string>
+#include <cstdint>
+
+namespace vsim { namespace physics {
+
+// On-disk store of cooked collision data (e.g. reduced convex hulls) so that expensive preprocessing of meshes is done once.
+// Entries are opaque binary blobs named after a content hash of their input. A cache with an empty directory is disabled.
+
+class ShapeCache {
+public:
+
+    ShapeCache(const std::string &dir = std::string()) ;
+
+    bool enabled() const { return !dir_.empty() ; }
+
+    // read the entry into data, returns false if the cache is disabled or the entry does not exist
+    bool load(const std::string &name, std::string &data) const ;
+
+    // Write the entry, failures are silently ignored since the data can always be recomputed. The entry is written to a
+    // temporary file and then renamed so that concurrent readers never see a partial file.
+    void store(const std::string &name, const std::string &data) const ;
+
+    // Memory map the entry, returns nullptr if the cache is disabled or the entry does not exist. The mapping is private and
+    // writable so that data structures may be fixed up in place (e.g. pointers), modified pages are never written back.
+    void *map(const std::string &name, size_t &size) const ;
+    static void unmap(void *data, size_t size) ;
+
+    // 64-bit FNV-1a hash of a byte buffer, seed allows chaining over several buffers
+    static uint64_t hash(const void *data, size_t size, uint64_t seed = 14695981039346656037ULL) ;
+
+    // entry name made of a prefix and the hex representation of the hash
+    static std::string entryName(const std::string &prefix, uint64_t hash) ;
+
+private:
+
+    std::string dir_ ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,524 @@
+#include "shape_library.hpp"
+#include "bullet_tools.hpp"
+#include "convex_decomposition.hpp"
+
+#include <BulletCollision/CollisionShapes/btShapeHull.h>
+#include <LinearMath/btConvexHullComputer.h>
+
+#include <vsim/physics/world.hpp>
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/collision_shape.hpp>
+#include <vsim/env/geometry.hpp>
+
+#include <vsim/util/format.hpp>
+#include <vsim/util/thread_pool.hpp>
+
+#include <tuple>
+#include <cstring>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+ShapeLibrary::ShapeLibrary(const PhysicsScenePtr &scene, const WorldConfig &config):
+    scene_(scene), cache_(config.shape_cache_dir_), decomposition_(config.convex_decomposition_) {
+
+    if ( decomposition_.enabled_ )
+        decomposeMeshes() ;
+
+    for( const RigidBodyPtr &b: scene_->bodies_ )
+        body_shapes_[b.get()] = createShape(*b) ;
+
+    for( const PhysicsModelPtr &m: scene_->models_ ) {
+        for( const RigidBodyPtr &b: m->bodies_ )
+            body_shapes_[b.get()] = createShape(*b) ;
+    }
+}
+
+ShapeLibrary::~ShapeLibrary() {
+    // shapes refer to the mapped BVH data
+    shapes_.clear() ;
+
+    for( const auto &m: mapped_bvhs_ )
+        ShapeCache::unmap(m.first, m.second) ;
+}
+
+btCollisionShape *ShapeLibrary::find(const RigidBody *body) const {
+    auto it = body_shapes_.find(body) ;
+    if ( it == body_shapes_.end() ) return nullptr ;
+    return it->second ;
+}
+
+enum ShapeType { BOX_SHAPE, PLANE_SHAPE, SPHERE_SHAPE, CYLINDER_SHAPE, CONE_SHAPE, MESH_SHAPE, COMPOUND_SHAPE, HEIGHTFIELD_SHAPE } ;
+
+bool ShapeLibrary::ShapeKey::operator < (const ShapeKey &other) const {
+    return std::tie(type_, refs_, params_) < std::tie(other.type_, other.refs_, other.params_) ;
+}
+
+btCollisionShape *ShapeLibrary::lookup(const ShapeKey &key) {
+    auto it = interned_.find(key) ;
+    if ( it == interned_.end() ) return nullptr ;
+    return it->second ;
+}
+
+btCollisionShape *ShapeLibrary::add(const ShapeKey &key, btCollisionShape *shape) {
+    shapes_.emplace_back(shape) ;
+    interned_.emplace(key, shape) ;
+    return shape ;
+}
+
+btCollisionShape *ShapeLibrary::createShape(const RigidBody &body) {
+
+    if ( body.shapes_.empty() )
+        throw PhysicsException(util::format("rigid body \"%\" has no collision shape", body.id_)) ;
+
+    if ( body.mass_ < 0 )
+        throw PhysicsException(util::format("rigid body \"%\" has negative mass", body.id_)) ;
+
+    bool is_static = body.isStatic() ;
+
+    // heightfields are concave and have no inertia
+    if ( !is_static ) {
+        for( const CollisionShapePtr &cs: body.shapes_ ) {
+            if ( dynamic_cast<const HeightfieldGeometry *>(cs->geom_.get()) )
+                throw PhysicsException(util::format("heightfield of rigid body \"%\" requires a static body (zero mass)", body.id_)) ;
+        }
+    }
+
+    const CollisionShape &first = *body.shapes_[0] ;
+
+    // the body reuses an existing shape if no new one was instantiated for it, lookups of compound children are not counted
+    size_t n_shapes = shapes_.size() ;
+    btCollisionShape *shape ;
+
+    if ( body.shapes_.size() == 1 && first.pose_.mat_.isApprox(Affine3f::Identity()) )
+        shape = createShape(*first.geom_, is_static) ;
+    else // several shapes or shape offset from the body frame
+        shape = createCompoundShape(body, is_static) ;
+
+    if ( shapes_.size() == n_shapes ) ++n_deduplicated_ ;
+
+    return shape ;
+}
+
+btCollisionShape *ShapeLibrary::createCompoundShape(const RigidBody &body, bool is_static) {
+
+    ShapeKey key ;
+    key.type_ = COMPOUND_SHAPE ;
+
+    // Geometries that are compounds themselves (e.g. cylinders offset along their axis, convex decompositions) are flattened
+    // so that a single tree covers all the leaf shapes of the body. Leaves are shared with other bodies and compounds.
+
+    vector<pair<btTransform, btCollisionShape *>> children ;
+
+    for( const CollisionShapePtr &cs: body.shapes_ ) {
+        btCollisionShape *child = createShape(*cs->geom_, is_static) ;
+        btTransform tr = toBullet(cs->pose_.mat_) ;
+
+        if ( child->isCompound() ) {
+            btCompoundShape *nested = static_cast<btCompoundShape *>(child) ;
+            for( int k=0 ; k<nested->getNumChildShapes() ; k++ )
+                children.emplace_back(tr * nested->getChildTransform(k), nested->getChildShape(k)) ;
+        } else
+            children.emplace_back(tr, child) ;
+    }
+
+    for( const auto &c: children ) {
+        key.refs_.push_back(c.second) ;
+
+        const btMatrix3x3 &r = c.first.getBasis() ;
+        const btVector3 &o = c.first.getOrigin() ;
+        for( int i=0 ; i<3 ; i++ )
+            key.params_.insert(key.params_.end(), { (float)r[i][0], (float)r[i][1], (float)r[i][2], (float)o[i] }) ;
+    }
+
+    if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+    // the dynamic tree over the children keeps the narrowphase of bodies made of many parts from testing all of them
+    btCompoundShape *compound = new btCompoundShape(true, children.size()) ;
+
+    for( const auto &c: children )
+        compound->addChildShape(c.first, c.second) ;
+
+    return add(key, compound) ;
+}
+
+// base on the origin and aligned with the z-axis, same convention as Mesh::createSolidCylinder
+static btCollisionShape *make_z_aligned(btCollisionShape *child, float h) {
+    btCompoundShape *compound = new btCompoundShape() ;
+    compound->addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(0, 0, h/2)), child) ;
+    return compound ;
+}
+
+btCollisionShape *ShapeLibrary::createShape(const Geometry &geom, bool is_static) {
+
+    ShapeKey key ;
+
+    if ( const BoxGeometry *box = dynamic_cast<const BoxGeometry *>(&geom) ) {
+        key.type_ = BOX_SHAPE ;
+        key.params_.assign(box->half_extents_.data(), box->half_extents_.data() + 3) ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        return add(key, new btBoxShape(toBullet(box->half_extents_))) ;
+    } else if ( const PlaneGeometry *plane = dynamic_cast<const PlaneGeometry *>(&geom) ) {
+        key.type_ = PLANE_SHAPE ;
+        key.params_.assign(plane->coeffs_.data(), plane->coeffs_.data() + 4) ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        Vector3f n = plane->coeffs_.head<3>() ;
+        float l = n.norm() ;
+        return add(key, new btStaticPlaneShape(toBullet(n/l), -plane->coeffs_.w()/l)) ;
+    } else if ( const SphereGeometry *sphere = dynamic_cast<const SphereGeometry *>(&geom) ) {
+        key.type_ = SPHERE_SHAPE ;
+        key.params_ = { sphere->radius_ } ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        return add(key, new btSphereShape(sphere->radius_)) ;
+    } else if ( const CylinderGeometry *cylinder = dynamic_cast<const CylinderGeometry *>(&geom) ) {
+        float r = cylinder->radius_, h = cylinder->height_ ;
+        key.type_ = CYLINDER_SHAPE ;
+        key.params_ = { r, h } ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        btCollisionShape *child = new btCylinderShapeZ(btVector3(r, r, h/2)) ;
+        shapes_.emplace_back(child) ;
+        return add(key, make_z_aligned(child, h)) ;
+    } else if ( const ConeGeometry *cone = dynamic_cast<const ConeGeometry *>(&geom) ) {
+        float r = cone->radius_, h = cone->height_ ;
+        key.type_ = CONE_SHAPE ;
+        key.params_ = { r, h } ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        btCollisionShape *child = new btConeShapeZ(r, h) ;
+        shapes_.emplace_back(child) ;
+        return add(key, make_z_aligned(child, h)) ;
+    } else if ( const HeightfieldGeometry *hf = dynamic_cast<const HeightfieldGeometry *>(&geom) ) {
+        key.type_ = HEIGHTFIELD_SHAPE ;
+        key.refs_ = { hf } ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        return add(key, createHeightfieldShape(*hf)) ;
+    } else if ( const Mesh *mesh = dynamic_cast<const Mesh *>(&geom) ) {
+        // meshes are identified by instance, comparing vertex data is left to the loaders that share mesh objects
+        enum { CONVEX_HULL, TRIANGLE_MESH, DECOMPOSED } mode = CONVEX_HULL ;
+        if ( mesh->ptype_ == Mesh::Triangles ) {
+            if ( is_static ) mode = TRIANGLE_MESH ;
+            else if ( decomposition_.enabled_ ) mode = DECOMPOSED ;
+        }
+
+        key.type_ = MESH_SHAPE ;
+        key.refs_ = { mesh } ;
+        key.params_ = { (float)mode } ;
+        if ( btCollisionShape *shape = lookup(key) ) return shape ;
+
+        if ( mode == DECOMPOSED )
+            return add(key, createDecomposedShape(*mesh)) ;
+        else if ( mode == TRIANGLE_MESH )
+            return add(key, createTriangleMeshShape(*mesh)) ;
+        else
+            return add(key, cookConvexHull(*mesh)) ;
+    } else
+        throw PhysicsException("unsupported collision geometry") ;
+}
+
+btCollisionShape *ShapeLibrary::createHeightfieldShape(const HeightfieldGeometry &hf) {
+
+    if ( hf.n_cols_ < 2 || hf.n_rows_ < 2 || hf.heights_.size() != hf.n_cols_ * hf.n_rows_ )
+        throw PhysicsException("invalid heightfield geometry") ;
+
+    // the samples are used in place so the geometry should outlive the shape, which is guaranteed by holding the scene
+
+    btHeightfieldTerrainShape *terrain = new btHeightfieldTerrainShape(hf.n_cols_, hf.n_rows_, hf.heights_.data(), 1.f,
+                                                                      hf.min_height_, hf.max_height_, 1, PHY_FLOAT, false) ;
+    terrain->setLocalScaling(btVector3(hf.size_.x()/( hf.n_cols_ - 1 ), 1.f, hf.size_.y()/( hf.n_rows_ - 1 ))) ;
+    shapes_.emplace_back(terrain) ;
+
+    // Bullet centers the shape on the middle of the height range, shift it so that heights are relative to the origin
+
+    btCompoundShape *compound = new btCompoundShape() ;
+    compound->addChildShape(btTransform(btQuaternion::getIdentity(), btVector3(0, ( hf.min_height_ + hf.max_height_ )/2, 0)), terrain) ;
+    return compound ;
+}
+
+// the serialized BVH depends on the Bullet version and the scalar type
+static const uint32_t BVH_VERSION = BT_BULLET_VERSION * 16 + sizeof(btScalar) ;
+
+btBvhTriangleMeshShape *ShapeLibrary::createTriangleMeshShape(const Mesh &mesh) {
+
+    btTriangleMesh *tmesh = new btTriangleMesh() ;
+    meshes_.emplace_back(tmesh) ;
+
+    const auto &v = mesh.vertices_ ;
+    const auto &idx = mesh.vertex_indices_ ;
+    for( size_t i=0 ; i+2<idx.size() ; i+=3 )
+        tmesh->addTriangle(toBullet(v[idx[i]]), toBullet(v[idx[i+1]]), toBullet(v[idx[i+2]])) ;
+
+    if ( !cache_.enabled() )
+        return new btBvhTriangleMeshShape(tmesh, true) ;
+
+    uint64_t h = ShapeCache::hash(&BVH_VERSION, sizeof(BVH_VERSION)) ;
+    h = ShapeCache::hash(v.data(), v.size() * sizeof(Vector3f), h) ;
+    h = ShapeCache::hash(idx.data(), idx.size() * sizeof(uint32_t), h) ;
+    string name = ShapeCache::entryName("bvh", h) ;
+
+    // the BVH is deserialized in place i.e. its node arrays point into the mapping, which stays alive as long as the library
+
+    size_t size ;
+    if ( void *data = cache_.map(name, size) ) {
+        if ( btOptimizedBvh *bvh = btOptimizedBvh::deSerializeInPlace(data, size, false) ) {
+            mapped_bvhs_.emplace_back(data, size) ;
+            btBvhTriangleMeshShape *shape = new btBvhTriangleMeshShape(tmesh, true, false) ;
+            shape->setOptimizedBvh(bvh) ;
+            return shape ;
+        }
+        ShapeCache::unmap(data, size) ;
+    }
+
+    btBvhTriangleMeshShape *shape = new btBvhTriangleMeshShape(tmesh, true) ;
+    btOptimizedBvh *bvh = shape->getOptimizedBvh() ;
+
+    // serialization requires a 16 byte aligned buffer
+    unsigned buffer_size = bvh->calculateSerializeBufferSize() ;
+    void *buffer = btAlignedAlloc(buffer_size, 16) ;
+
+    if ( bvh->serializeInPlace(buffer, buffer_size, false) )
+        cache_.store(name, string(static_cast<const char *>(buffer), buffer_size)) ;
+
+    btAlignedFree(buffer) ;
+
+    return shape ;
+}
+
+// Bullet rounds convex hulls by their collision margin, which lies outside of the vertices. The hull is shrunk by the
+// margin so that the rounded shape matches the geometry. The margin is Bullet's default, clamped to a quarter of the
+// distance from the center of the hull to its closest face so that small or thin hulls keep their volume.
+
+ShapeLibrary::ConvexHull ShapeLibrary::shrinkHull(const btVector3 *points, int n_points) {
+
+    const float max_margin = CONVEX_DISTANCE_MARGIN, clamp = 0.25f ;
+
+    ConvexHull hull ;
+
+    btConvexHullComputer hc ;
+    btScalar margin = hc.compute(&points[0].x(), sizeof(btVector3), n_points, max_margin, clamp) ;
+
+    if ( margin > 0 && hc.vertices.size() > 0 ) {
+        hull.margin_ = margin ;
+        for( int i=0 ; i<hc.vertices.size() ; i++ )
+            hull.vertices_.emplace_back(hc.vertices[i].x(), hc.vertices[i].y(), hc.vertices[i].z()) ;
+    } else { // degenerate hull, keep the vertices without margin
+        hull.margin_ = 0 ;
+        for( int i=0 ; i<n_points ; i++ )
+            hull.vertices_.emplace_back(points[i].x(), points[i].y(), points[i].z()) ;
+    }
+
+    return hull ;
+}
+
+btConvexHullShape *ShapeLibrary::createHullShape(const ConvexHull &hull) {
+    btConvexHullShape *shape = new btConvexHullShape() ;
+    for( const Vector3f &v: hull.vertices_ )
+        shape->addPoint(toBullet(v), false) ;
+    shape->setMargin(hull.margin_) ;
+    shape->recalcLocalAabb() ;
+    return shape ;
+}
+
+// bump when the cooking procedure changes so that stale cache entries are ignored
+static const uint32_t HULL_COOKING_VERSION = 2 ;
+
+btConvexHullShape *ShapeLibrary::cookConvexHull(const Mesh &mesh) {
+
+    const auto &vertices = mesh.vertices_ ;
+
+    uint64_t h = ShapeCache::hash(&HULL_COOKING_VERSION, sizeof(HULL_COOKING_VERSION)) ;
+    h = ShapeCache::hash(vertices.data(), vertices.size() * sizeof(Vector3f), h) ;
+    string name = ShapeCache::entryName("hull", h) ;
+
+    // cache entries are the collision margin followed by the packed (x, y, z) coordinates of the shrunk hull vertices
+
+    ConvexHull hull ;
+    string data ;
+
+    if ( cache_.load(name, data) && data.size() > sizeof(float) && ( data.size() - sizeof(float) ) % sizeof(Vector3f) == 0 ) {
+        memcpy(&hull.margin_, data.data(), sizeof(float)) ;
+        hull.vertices_.resize(( data.size() - sizeof(float) )/sizeof(Vector3f)) ;
+        memcpy(hull.vertices_.data()->data(), data.data() + sizeof(float), data.size() - sizeof(float)) ;
+        return createHullShape(hull) ;
+    }
+
+    btConvexHullShape full ;
+    for( const Vector3f &v: vertices )
+        full.addPoint(toBullet(v), false) ;
+    full.recalcLocalAabb() ;
+
+    // btShapeHull samples the support function in a fixed set of directions which reduces the hull to at most a few dozen
+    // vertices. The support points would include the collision margin, so remove it.
+
+    full.setMargin(0) ;
+
+    btShapeHull reducer(&full) ;
+    const btVector3 *points = full.getUnscaledPoints() ;
+    int n_points = full.getNumPoints() ;
+
+    if ( reducer.buildHull(0) ) {
+        points = reducer.getVertexPointer() ;
+        n_points = reducer.numVertices() ;
+    }
+
+    hull = shrinkHull(points, n_points) ;
+
+    data.assign(reinterpret_cast<const char *>(&hull.margin_), sizeof(float)) ;
+    data.append(reinterpret_cast<const char *>(hull.vertices_.data()), hull.vertices_.size() * sizeof(Vector3f)) ;
+    cache_.store(name, data) ;
+
+    return createHullShape(hull) ;
+}
+
+void ShapeLibrary::decomposeMeshes() {
+
+    vector<const Mesh *> meshes ;
+
+    auto collect = [&](const RigidBodyPtr &b) {
+        if ( b->isStatic() ) return ;
+        for( const CollisionShapePtr &cs: b->shapes_ ) {
+            const Mesh *mesh = dynamic_cast<const Mesh *>(cs->geom_.get()) ;
+            if ( mesh && mesh->ptype_ == Mesh::Triangles && !decompositions_.count(mesh) ) {
+                decompositions_[mesh] ;
+                meshes.push_back(mesh) ;
+            }
+        }
+    } ;
+
+    for( const RigidBodyPtr &b: scene_->bodies_ )
+        collect(b) ;
+
+    for( const PhysicsModelPtr &m: scene_->models_ ) {
+        for( const RigidBodyPtr &b: m->bodies_ )
+            collect(b) ;
+    }
+
+    // map entries exist for all meshes so they are only written (not inserted) by the tasks
+
+    util::ThreadPool::instance().parallelFor(meshes.size(), [&](size_t i) {
+        decompositions_.find(meshes[i])->second = decompose(*meshes[i]) ;
+    }) ;
+}
+
+// bump when the decomposition algorithm changes so that stale cache entries are ignored
+static const uint32_t DECOMPOSITION_VERSION = 2 ;
+
+vector<ShapeLibrary::ConvexHull> ShapeLibrary::decompose(const Mesh &mesh) const {
+
+    uint64_t h = ShapeCache::hash(&DECOMPOSITION_VERSION, sizeof(DECOMPOSITION_VERSION)) ;
+    h = ShapeCache::hash(mesh.vertices_.data(), mesh.vertices_.size() * sizeof(Vector3f), h) ;
+    h = ShapeCache::hash(mesh.vertex_indices_.data(), mesh.vertex_indices_.size() * sizeof(uint32_t), h) ;
+
+    uint64_t params[] = { decomposition_.max_parts_, decomposition_.max_part_vertices_ } ;
+    h = ShapeCache::hash(params, sizeof(params), h) ;
+    h = ShapeCache::hash(&decomposition_.concavity_, sizeof(float), h) ;
+
+    string name = ShapeCache::entryName("acd", h) ;
+
+    // cache entries are the number of parts followed by the number of vertices, the collision margin and the packed vertex
+    // coordinates of each part
+
+    vector<ConvexHull> parts ;
+    string data ;
+
+    if ( cache_.load(name, data) ) {
+        const char *ptr = data.data(), *end = ptr + data.size() ;
+        uint32_t n_parts, n_vertices ;
+
+        bool valid = ( ptr + sizeof(uint32_t) <= end ) ;
+        if ( valid ) {
+            memcpy(&n_parts, ptr, sizeof(uint32_t)) ; ptr += sizeof(uint32_t) ;
+            for( uint32_t i=0 ; valid && i<n_parts ; i++ ) {
+                valid = ( ptr + sizeof(uint32_t) + sizeof(float) <= end ) ;
+                if ( !valid ) break ;
+                memcpy(&n_vertices, ptr, sizeof(uint32_t)) ; ptr += sizeof(uint32_t) ;
+                parts.emplace_back() ;
+                memcpy(&parts.back().margin_, ptr, sizeof(float)) ; ptr += sizeof(float) ;
+
+                valid = ( ptr + n_vertices * sizeof(Vector3f) <= end ) ;
+                if ( !valid ) break ;
+                parts.back().vertices_.resize(n_vertices) ;
+                memcpy(parts.back().vertices_.data()->data(), ptr, n_vertices * sizeof(Vector3f)) ;
+                ptr += n_vertices * sizeof(Vector3f) ;
+            }
+        }
+
+        if ( valid && ptr == end && !parts.empty() ) return parts ;
+        parts.clear() ;
+    }
+
+    // parts are shrunk by their margin, otherwise the outer surface would be inflated and cavities narrowed by the margin
+
+    for( const vector<Vector3f> &part: convex_decomposition(mesh, decomposition_) ) {
+        vector<btVector3> points ;
+        for( const Vector3f &v: part )
+            points.push_back(toBullet(v)) ;
+        if ( !points.empty() )
+            parts.emplace_back(shrinkHull(points.data(), points.size())) ;
+    }
+
+    uint32_t n_parts = parts.size() ;
+    data.assign(reinterpret_cast<const char *>(&n_parts), sizeof(uint32_t)) ;
+    for( const auto &part: parts ) {
+        uint32_t n_vertices = part.vertices_.size() ;
+        data.append(reinterpret_cast<const char *>(&n_vertices), sizeof(uint32_t)) ;
+        data.append(reinterpret_cast<const char *>(&part.margin_), sizeof(float)) ;
+        data.append(reinterpret_cast<const char *>(part.vertices_.data()), part.vertices_.size() * sizeof(Vector3f)) ;
+    }
+
+    cache_.store(name, data) ;
+
+    return parts ;
+}
+
+btCollisionShape *ShapeLibrary::createDecomposedShape(const Mesh &mesh) {
+
+    auto it = decompositions_.find(&mesh) ;
+    const vector<ConvexHull> &parts = ( it != decompositions_.end() ) ? it->second : ( decompositions_[&mesh] = decompose(mesh) ) ;
+
+    if ( parts.empty() )
+        throw PhysicsException("convex decomposition of mesh failed") ;
+
+    if ( parts.size() == 1 ) return createHullShape(parts[0]) ;
+
+    // parts are in mesh coordinates so they are added to the compound with identity transforms
+
+    btCompoundShape *compound = new btCompoundShape() ;
+    btTransform identity ;
+    identity.setIdentity() ;
+
+    for( const auto &part: parts ) {
+        btConvexHullShape *hull = createHullShape(part) ;
+        shapes_.emplace_back(hull) ;
+        compound->addChildShape(identity, hull) ;
+    }
+
+    return compound ;
+}
+
+void ShapeLibrary::collisionFilter(const RigidBody &body, bool is_static, int &group, int &mask) {
+    group = body.collision_group_ ;
+    mask = body.collision_mask_ ;
+
+    for( const CollisionShapePtr &cs: body.shapes_ ) {
+        group |= cs->collision_group_ ;
+        mask &= cs->collision_mask_ ;
+    }
+
+    if ( group == 0 )
+        group = is_static ? btBroadphaseProxy::StaticFilter : btBroadphaseProxy::DefaultFilter ;
+
+    if ( is_static )
+        mask &= ~btBroadphaseProxy::StaticFilter ;
+}
+
+}}
@@ -0,0 +1,108 @@
+#ifndef __VSIM_PHYSICS_SHAPE_LIBRARY_HPP__
+#define __VSIM_PHYSICS_SHAPE_LIBRARY_HPP__
+
+#include <memory>
+#include <vector>
+#include <map>
+
+#include <btBulletDynamicsCommon.h>
+
+#include <Eigen/Core>
+
+#include <vsim/env/scene_fwd.hpp>
+#include <vsim/physics/world.hpp>
+
+#include "shape_cache.hpp"
+
+namespace vsim { namespace physics {
+
+class ShapeLibrary ;
+typedef std::shared_ptr<ShapeLibrary> ShapeLibraryPtr ;
+
+// Bullet collision shapes of all bodies in a physics scene. Shapes are not modified during simulation so a single
+// library may be shared by several worlds instantiated from the same scene, also across threads.
+// Shapes are interned: geometries with identical parameters (e.g. boxes of the same size), bodies referencing the same
+// mesh and compounds made of the same children at the same poses all map to a single Bullet shape. Bodies with several
+// shapes get a flat compound with a dynamic AABB tree over the children and thus a single broadphase proxy.
+
+class ShapeLibrary {
+public:
+
+    // Convex hulls and decompositions of dynamic meshes are cooked once and stored in config.shape_cache_dir_ (if not empty)
+    ShapeLibrary(const PhysicsScenePtr &scene, const WorldConfig &config = WorldConfig()) ;
+    ~ShapeLibrary() ;
+
+    // shape created for the given body or nullptr if the body is not part of the scene
+    btCollisionShape *find(const RigidBody *body) const ;
+
+    // Broadphase group and mask of the body, merging those of its shapes. Bodies with group zero get the Bullet defaults
+    // (static or default filter) and static bodies never collide with the static group.
+    static void collisionFilter(const RigidBody &body, bool is_static, int &group, int &mask) ;
+
+    // number of distinct shapes instantiated (including children of compound shapes)
+    size_t numShapes() const { return shapes_.size() ; }
+
+    // number of bodies whose shape was served by an existing shape
+    size_t numDeduplicated() const { return n_deduplicated_ ; }
+
+private:
+
+    // identifies a shape by its type, the objects it refers to (meshes or child shapes) and its numerical parameters
+    struct ShapeKey {
+        int type_ ;
+        std::vector<const void *> refs_ ;
+        std::vector<float> params_ ;
+
+        bool operator < (const ShapeKey &other) const ;
+    };
+
+    btCollisionShape *createShape(const RigidBody &body) ;
+    btCollisionShape *createShape(const Geometry &geom, bool is_static) ;
+    btCollisionShape *createCompoundShape(const RigidBody &body, bool is_static) ;
+
+    // vertices of a convex hull shrunk by the collision margin of its shape, so that the rounded shape matches the geometry
+    struct ConvexHull {
+        std::vector<Eigen::Vector3f> vertices_ ;
+        float margin_ ;
+    };
+
+    static ConvexHull shrinkHull(const btVector3 *points, int n_points) ;
+    static btConvexHullShape *createHullShape(const ConvexHull &hull) ;
+
+    // reduced convex hull of the mesh vertices, loaded from the cache if available
+    btConvexHullShape *cookConvexHull(const Mesh &mesh) ;
+
+    // triangle mesh shape whose BVH is memory mapped from the cache or built and serialized to it
+    btBvhTriangleMeshShape *createTriangleMeshShape(const Mesh &mesh) ;
+
+    // decompose all distinct dynamic meshes of the scene in parallel
+    void decomposeMeshes() ;
+
+    // shrunk convex parts of the mesh, loaded from the cache if available
+    std::vector<ConvexHull> decompose(const Mesh &mesh) const ;
+    btCollisionShape *createDecomposedShape(const Mesh &mesh) ;
+
+    // returns the shape registered with the key or nullptr, in which case the caller should add a new one
+    btCollisionShape *lookup(const ShapeKey &key) ;
+    btCollisionShape *add(const ShapeKey &key, btCollisionShape *shape) ;
+
+    btCollisionShape *createHeightfieldShape(const HeightfieldGeometry &hf) ;
+
+    // keeps geometry data referenced by the shapes (e.g. heightfield samples) alive
+    PhysicsScenePtr scene_ ;
+
+    std::vector<std::unique_ptr<btTriangleMesh>> meshes_ ;
+    std::vector<std::unique_ptr<btCollisionShape>> shapes_ ;
+
+    std::map<const RigidBody *, btCollisionShape *> body_shapes_ ;
+    std::map<ShapeKey, btCollisionShape *> interned_ ;
+    ShapeCache cache_ ;
+    std::vector<std::pair<void *, size_t>> mapped_bvhs_ ; // cache entries backing deserialized BVHs
+    ConvexDecompositionParams decomposition_ ;
+    std::map<const Mesh *, std::vector<ConvexHull>> decompositions_ ;
+    size_t n_deduplicated_ = 0 ;
+} ;
+
+}}
+
+#endif
@@ -0,0 +1,80 @@
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+TaskScheduler::TaskScheduler(util::ThreadPool &pool): btITaskScheduler("vsim"), pool_(pool) {
+}
+
+// Bullet sizes its per thread storage (e.g. the solver pool of btDiscreteDynamicsWorldMt) by the number of threads and
+// indexes it by btGetCurrentThreadIndex(), which is only valid below BT_MAX_THREAD_COUNT.
+
+int TaskScheduler::getMaxNumThreads() const {
+    return std::min<int>(pool_.numThreads(), BT_MAX_THREAD_COUNT) ;
+}
+
+int TaskScheduler::getNumThreads() const {
+    return std::min<int>(pool_.numThreads(), BT_MAX_THREAD_COUNT) ;
+}
+
+void TaskScheduler::setNumThreads(int) {
+    // the size of the pool is fixed
+}
+
+void TaskScheduler::parallelFor(int begin, int end, int grain_size, const btIParallelForBody &body) {
+    if ( end <= begin ) return ;
+
+    size_t grain = std::max(grain_size, 1) ;
+    size_t n_chunks = ( end - begin + grain - 1 ) / grain ;
+
+    pool_.parallelFor(n_chunks, [&](size_t c) {
+        int b = begin + c * grain ;
+        int e = std::min<int>(b + grain, end) ;
+        body.forLoop(b, e) ;
+    }) ;
+}
+
+#if BT_BULLET_VERSION >= 288
+btScalar TaskScheduler::parallelSum(int begin, int end, int grain_size, const btIParallelSumBody &body) {
+    if ( end <= begin ) return 0 ;
+
+    size_t grain = std::max(grain_size, 1) ;
+    size_t n_chunks = ( end - begin + grain - 1 ) / grain ;
+
+    btScalar sum = 0 ;
+    mutex sum_mutex ;
+
+    pool_.parallelFor(n_chunks, [&](size_t c) {
+        int b = begin + c * grain ;
+        int e = std::min<int>(b + grain, end) ;
+        btScalar s = body.sumLoop(b, e) ;
+
+        lock_guard<mutex> lock(sum_mutex) ;
+        sum += s ;
+    }) ;
+
+    return sum ;
+}
+#endif
+
+util::ThreadPool &TaskScheduler::schedulerPool() {
+    util::ThreadPool &shared = util::ThreadPool::instance() ;
+    if ( shared.numThreads() <= BT_MAX_THREAD_COUNT ) return shared ;
+
+    // more cores than Bullet supports threads, physics gets a pool of its own of the maximum size
+    static util::ThreadPool clamped(BT_MAX_THREAD_COUNT) ;
+    return clamped ;
+}
+
+void TaskScheduler::install() {
+    static TaskScheduler scheduler(schedulerPool()) ;
+    static once_flag flag ;
+
+    call_once(flag, [] { btSetTaskScheduler(&scheduler) ; }) ;
+}
+
+}}
@@ -0,0 +1,40 @@
+#ifndef __VSIM_PHYSICS_TASK_SCHEDULER_HPP__
+#define __VSIM_PHYSICS_TASK_SCHEDULER_HPP__
+
+#include <LinearMath/btThreads.h>
+
+#include <vsim/util/thread_pool.hpp>
+
+namespace vsim { namespace physics {
+
+// Bullet task scheduler that runs the parallel loops of the multithreaded dynamics world on a vsim thread pool, so that
+// physics shares the worker threads with the rest of the simulator instead of spawning its own
+
+class TaskScheduler: public btITaskScheduler {
+public:
+
+    TaskScheduler(util::ThreadPool &pool) ;
+
+    int getMaxNumThreads() const override ;
+    int getNumThreads() const override ;
+    void setNumThreads(int num_threads) override ;
+
+    void parallelFor(int begin, int end, int grain_size, const btIParallelForBody &body) override ;
+#if BT_BULLET_VERSION >= 288
+    btScalar parallelSum(int begin, int end, int grain_size, const btIParallelSumBody &body) override ;
+#endif
+
+    // installs the scheduler of the process wide thread pool as the global Bullet scheduler (done once)
+    static void install() ;
+
+private:
+
+    // the process wide pool unless it has more than BT_MAX_THREAD_COUNT threads
+    static util::ThreadPool &schedulerPool() ;
+
+    util::ThreadPool &pool_ ;
+} ;
+
+}}
+
+#endif
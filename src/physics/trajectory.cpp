@@ -0,0 +1,381 @@
+#include <vsim/physics/trajectory.hpp>
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <zlib.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <limits>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+using detail::TRAJECTORY_COLUMNS ;
+using detail::TrajectoryChunk ;
+
+static const char TRAJECTORY_MAGIC[8] = { 'V', 'S', 'I', 'M', 'T', 'R', 'J', '1' } ;
+
+// Group bytes of equal significance of the floats together (all first bytes, then all second bytes etc.). Sign and exponent
+// bytes of slowly varying quantities are then mostly constant which zlib compresses far better than interleaved floats.
+
+static void shuffle_bytes(const float *src, size_t n, uint8_t *dst) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(src) ;
+    for( size_t i=0 ; i<n ; i++ )
+        for( size_t b=0 ; b<sizeof(float) ; b++ )
+            dst[b * n + i] = bytes[i * sizeof(float) + b] ;
+}
+
+static void unshuffle_bytes(const uint8_t *src, size_t n, float *dst) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(dst) ;
+    for( size_t i=0 ; i<n ; i++ )
+        for( size_t b=0 ; b<sizeof(float) ; b++ )
+            bytes[i * sizeof(float) + b] = src[b * n + i] ;
+}
+
+template<class T>
+static void write_value(ostream &strm, const T &v) {
+    strm.write(reinterpret_cast<const char *>(&v), sizeof(T)) ;
+}
+
+// reads a value stored at ptr, throws if it extends past end
+template<class T>
+static T read_value(const uint8_t *&ptr, const uint8_t *end) {
+    if ( end - ptr < (ptrdiff_t)sizeof(T) )
+        throw TrajectoryException("truncated trajectory file") ;
+
+    T v ;
+    memcpy(&v, ptr, sizeof(T)) ;
+    ptr += sizeof(T) ;
+    return v ;
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const string &fname, const PhysicsScenePtr &scene, size_t chunk_size, int compression_level):
+    chunk_size_(chunk_size), compression_level_(compression_level) {
+
+    for( const RigidBodyPtr &b: scene->bodies_ )
+        bodies_.push_back(b.get()) ;
+
+    for( const PhysicsModelPtr &m: scene->models_ ) {
+        for( const RigidBodyPtr &b: m->bodies_ )
+            bodies_.push_back(b.get()) ;
+    }
+
+    open(fname) ;
+}
+
+TrajectoryRecorder::TrajectoryRecorder(const string &fname, const vector<const RigidBody *> &bodies, size_t chunk_size, int compression_level):
+    bodies_(bodies), chunk_size_(chunk_size), compression_level_(compression_level) {
+    open(fname) ;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    // errors can only be reported by an explicit close(), the file is then left without an index
+    try {
+        close() ;
+    } catch ( ... ) {
+    }
+}
+
+// a failed write leaves the file incomplete, it is closed so that later calls do not append to it
+void TrajectoryRecorder::checkStream() {
+    if ( strm_ ) return ;
+
+    strm_.close() ;
+    throw TrajectoryException(util::format("error writing to \"%\"", fname_)) ;
+}
+
+void TrajectoryRecorder::open(const string &fname) {
+
+    if ( chunk_size_ == 0 )
+        throw TrajectoryException("chunk size should be positive") ;
+
+    fname_ = fname ;
+
+    strm_.open(fname, ios::binary) ;
+    if ( !strm_ )
+        throw TrajectoryException(util::format("cannot open \"%\" for writing", fname)) ;
+
+    strm_.write(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) ;
+    write_value<uint32_t>(strm_, bodies_.size()) ;
+    write_value<uint32_t>(strm_, chunk_size_) ;
+
+    for( const RigidBody *b: bodies_ ) {
+        write_value<uint32_t>(strm_, b->id_.size()) ;
+        strm_.write(b->id_.data(), b->id_.size()) ;
+    }
+
+    checkStream() ;
+
+    // all buffers are sized for a full chunk so that recording does not allocate
+
+    columns_[0].resize(chunk_size_) ;
+    for( size_t c=1 ; c<TRAJECTORY_COLUMNS ; c++ )
+        columns_[c].resize(chunk_size_ * bodies_.size()) ;
+
+    size_t max_bytes = std::max<size_t>(chunk_size_ * bodies_.size(), chunk_size_) * sizeof(float) ;
+    shuffled_.resize(max_bytes) ;
+    compressed_.resize(compressBound(max_bytes)) ;
+}
+
+void TrajectoryRecorder::record(float t) {
+
+    if ( !strm_.is_open() )
+        throw TrajectoryException("recorder is closed") ;
+
+    columns_[0][n_steps_] = t ;
+
+    size_t offset = n_steps_ * bodies_.size() ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const RigidBody *b = bodies_[i] ;
+        size_t idx = offset + i ;
+
+        Vector3f p = b->pose_.mat_.translation() ;
+        Quaternionf q(b->pose_.mat_.linear()) ;
+
+        columns_[1][idx] = p.x() ; columns_[2][idx] = p.y() ; columns_[3][idx] = p.z() ;
+        columns_[4][idx] = q.x() ; columns_[5][idx] = q.y() ; columns_[6][idx] = q.z() ; columns_[7][idx] = q.w() ;
+        columns_[8][idx] = b->velocity_.x() ; columns_[9][idx] = b->velocity_.y() ; columns_[10][idx] = b->velocity_.z() ;
+        columns_[11][idx] = b->angular_velocity_.x() ; columns_[12][idx] = b->angular_velocity_.y() ; columns_[13][idx] = b->angular_velocity_.z() ;
+    }
+
+    if ( ++n_steps_ == chunk_size_ )
+        flush() ;
+}
+
+void TrajectoryRecorder::writeColumn(const float *data, size_t n) {
+
+    shuffle_bytes(data, n, shuffled_.data()) ;
+
+    uLongf compressed_size = compressed_.size() ;
+    if ( compress2(compressed_.data(), &compressed_size, shuffled_.data(), n * sizeof(float), compression_level_) != Z_OK )
+        throw TrajectoryException("zlib compression failed") ;
+
+    strm_.write(reinterpret_cast<const char *>(compressed_.data()), compressed_size) ;
+    checkStream() ;
+}
+
+void TrajectoryRecorder::flush() {
+
+    if ( n_steps_ == 0 ) return ;
+
+    TrajectoryChunk chunk ;
+    chunk.n_steps_ = n_steps_ ;
+
+    for( size_t c=0 ; c<TRAJECTORY_COLUMNS ; c++ ) {
+        uint64_t offset = strm_.tellp() ;
+        size_t n = ( c == 0 ) ? n_steps_ : n_steps_ * bodies_.size() ;
+
+        writeColumn(columns_[c].data(), n) ;
+
+        chunk.offsets_[c] = offset ;
+        chunk.sizes_[c] = (uint64_t)strm_.tellp() - offset ;
+    }
+
+    index_.push_back(chunk) ;
+    n_steps_ = 0 ;
+}
+
+void TrajectoryRecorder::close() {
+
+    if ( !strm_.is_open() ) return ;
+
+    flush() ;
+
+    uint64_t index_offset = strm_.tellp() ;
+
+    write_value<uint64_t>(strm_, index_.size()) ;
+
+    for( const TrajectoryChunk &chunk: index_ ) {
+        write_value<uint32_t>(strm_, chunk.n_steps_) ;
+        for( size_t c=0 ; c<TRAJECTORY_COLUMNS ; c++ ) {
+            write_value<uint64_t>(strm_, chunk.offsets_[c]) ;
+            write_value<uint32_t>(strm_, chunk.sizes_[c]) ;
+        }
+    }
+
+    write_value<uint64_t>(strm_, index_offset) ;
+    strm_.write(TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) ;
+
+    strm_.close() ;
+    checkStream() ;
+}
+
+const size_t TrajectoryReader::STATE_SIZE ;
+
+TrajectoryReader::TrajectoryReader(const string &fname) {
+
+    int fd = ::open(fname.c_str(), O_RDONLY) ;
+    if ( fd < 0 )
+        throw TrajectoryException(util::format("cannot open \"%\"", fname)) ;
+
+    struct stat st ;
+    if ( fstat(fd, &st) < 0 ) {
+        ::close(fd) ;
+        throw TrajectoryException(util::format("cannot open \"%\"", fname)) ;
+    }
+
+    size_ = st.st_size ;
+
+    void *addr = ( size_ > 0 ) ? mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED ;
+    ::close(fd) ;
+
+    if ( addr == MAP_FAILED )
+        throw TrajectoryException(util::format("cannot map \"%\"", fname)) ;
+
+    data_ = static_cast<const uint8_t *>(addr) ;
+
+    try {
+        const size_t trailer_size = sizeof(uint64_t) + sizeof(TRAJECTORY_MAGIC) ;
+
+        if ( size_ < sizeof(TRAJECTORY_MAGIC) + 2 * sizeof(uint32_t) + trailer_size ||
+             memcmp(data_, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 ||
+             memcmp(data_ + size_ - sizeof(TRAJECTORY_MAGIC), TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC)) != 0 )
+            throw TrajectoryException(util::format("\"%\" is not a complete trajectory file", fname)) ;
+
+        // All offsets and sizes are checked against the file layout here so that decoding never reads outside the mapping:
+        // header, columns and index follow each other and the index ends at the trailer.
+
+        const uint8_t *trailer = data_ + size_ - trailer_size ;
+        const uint8_t *ptr = trailer ;
+
+        uint64_t index_offset = read_value<uint64_t>(ptr, data_ + size_) ;
+        if ( index_offset > size_ - trailer_size )
+            throw TrajectoryException(util::format("invalid index offset in \"%\"", fname)) ;
+
+        const uint8_t *index = data_ + index_offset ;
+
+        ptr = data_ + sizeof(TRAJECTORY_MAGIC) ;
+
+        uint32_t n_bodies = read_value<uint32_t>(ptr, index) ;
+        chunk_size_ = read_value<uint32_t>(ptr, index) ;
+
+        if ( chunk_size_ == 0 )
+            throw TrajectoryException(util::format("invalid chunk size in \"%\"", fname)) ;
+
+        for( uint32_t i=0 ; i<n_bodies ; i++ ) {
+            uint32_t len = read_value<uint32_t>(ptr, index) ;
+            if ( (size_t)( index - ptr ) < len )
+                throw TrajectoryException(util::format("truncated header in \"%\"", fname)) ;
+
+            body_ids_.emplace_back(reinterpret_cast<const char *>(ptr), len) ;
+            ptr += len ;
+        }
+
+        uint64_t header_size = ptr - data_ ;
+
+        ptr = index ;
+
+        uint64_t n_chunks = read_value<uint64_t>(ptr, trailer) ;
+        const size_t entry_size = sizeof(uint32_t) + TRAJECTORY_COLUMNS * ( sizeof(uint64_t) + sizeof(uint32_t) ) ;
+
+        if ( n_chunks > (uint64_t)( trailer - ptr ) / entry_size )
+            throw TrajectoryException(util::format("invalid index in \"%\"", fname)) ;
+
+        index_.resize(n_chunks) ;
+
+        n_steps_ = 0 ;
+
+        for( size_t k=0 ; k<index_.size() ; k++ ) {
+            TrajectoryChunk &chunk = index_[k] ;
+            chunk.n_steps_ = read_value<uint32_t>(ptr, trailer) ;
+
+            // steps are located by assuming that all chunks but the last one are full
+            if ( chunk.n_steps_ == 0 || chunk.n_steps_ > chunk_size_ || ( k + 1 < index_.size() && chunk.n_steps_ != chunk_size_ ) )
+                throw TrajectoryException(util::format("invalid chunk % in \"%\"", k, fname)) ;
+
+            for( size_t c=0 ; c<TRAJECTORY_COLUMNS ; c++ ) {
+                chunk.offsets_[c] = read_value<uint64_t>(ptr, trailer) ;
+                chunk.sizes_[c] = read_value<uint32_t>(ptr, trailer) ;
+
+                if ( chunk.offsets_[c] < header_size || chunk.offsets_[c] > index_offset || chunk.sizes_[c] > index_offset - chunk.offsets_[c] )
+                    throw TrajectoryException(util::format("invalid column % of chunk % in \"%\"", c, k, fname)) ;
+            }
+
+            n_steps_ += chunk.n_steps_ ;
+        }
+    }
+    catch ( ... ) {
+        munmap(const_cast<uint8_t *>(data_), size_) ;
+        throw ;
+    }
+
+    for( size_t c=0 ; c<TRAJECTORY_COLUMNS ; c++ )
+        cached_chunk_[c] = numeric_limits<size_t>::max() ;
+}
+
+TrajectoryReader::~TrajectoryReader() {
+    munmap(const_cast<uint8_t *>(data_), size_) ;
+}
+
+const float *TrajectoryReader::decodeColumn(size_t column, size_t chunk) {
+
+    vector<float> &values = columns_[column] ;
+
+    if ( cached_chunk_[column] == chunk ) return values.data() ;
+
+    const TrajectoryChunk &entry = index_[chunk] ;
+    size_t n = ( column == 0 ) ? entry.n_steps_ : entry.n_steps_ * body_ids_.size() ;
+
+    shuffled_.resize(n * sizeof(float)) ;
+    values.resize(n) ;
+
+    uLongf size = shuffled_.size() ;
+    if ( uncompress(shuffled_.data(), &size, data_ + entry.offsets_[column], entry.sizes_[column]) != Z_OK || size != n * sizeof(float) )
+        throw TrajectoryException("corrupted trajectory column") ;
+
+    unshuffle_bytes(shuffled_.data(), n, values.data()) ;
+
+    cached_chunk_[column] = chunk ;
+    return values.data() ;
+}
+
+float TrajectoryReader::value(size_t column, size_t step, size_t body) {
+
+    if ( step >= n_steps_ || body >= body_ids_.size() )
+        throw TrajectoryException("trajectory access out of range") ;
+
+    // all chunks are full except possibly the last one
+    size_t chunk = step / chunk_size_, local = step % chunk_size_ ;
+
+    const float *values = decodeColumn(column, chunk) ;
+    return ( column == 0 ) ? values[local] : values[local * body_ids_.size() + body] ;
+}
+
+float TrajectoryReader::time(size_t step) {
+    return value(0, step, 0) ;
+}
+
+Vector3f TrajectoryReader::position(size_t step, size_t body) {
+    return Vector3f(value(1, step, body), value(2, step, body), value(3, step, body)) ;
+}
+
+Quaternionf TrajectoryReader::orientation(size_t step, size_t body) {
+    return Quaternionf(value(7, step, body), value(4, step, body), value(5, step, body), value(6, step, body)) ;
+}
+
+Vector3f TrajectoryReader::velocity(size_t step, size_t body) {
+    return Vector3f(value(8, step, body), value(9, step, body), value(10, step, body)) ;
+}
+
+Vector3f TrajectoryReader::angularVelocity(size_t step, size_t body) {
+    return Vector3f(value(11, step, body), value(12, step, body), value(13, step, body)) ;
+}
+
+void TrajectoryReader::getState(size_t step, size_t body, float *state) {
+    for( size_t c=1 ; c<TRAJECTORY_COLUMNS ; c++ )
+        *state++ = value(c, step, body) ;
+}
+
+}}
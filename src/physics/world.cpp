@@ -0,0 +1,146 @@
+#include <vsim/physics/world.hpp>
+#include "world_impl.hpp"
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+World::World(const PhysicsScenePtr &scene, const WorldConfig &config): impl_(new WorldImpl(scene, config)) {
+}
+
+World::~World() {
+}
+
+void World::step(float dt) {
+    impl_->step(dt) ;
+}
+
+size_t World::numBodies() const {
+    return impl_->bodies_.size() ;
+}
+
+RigidBody *World::body(size_t idx) const {
+    return impl_->bodies_[idx].body_ ;
+}
+
+const vector<size_t> &World::activeBodies() const {
+    return impl_->active_bodies_ ;
+}
+
+int World::findBody(const string &id) const {
+    return impl_->findBody(id) ;
+}
+
+float World::time() const {
+    return impl_->time_ ;
+}
+
+void World::getStates(float *pos, float *quat, float *linvel, float *angvel) const {
+    impl_->getStates(pos, quat, linvel, angvel) ;
+}
+
+void World::applyForces(const float *forces, const float *torques) {
+    impl_->applyForces(forces, torques) ;
+}
+
+void World::applyImpulses(const float *impulses, const float *angular_impulses) {
+    impl_->applyImpulses(impulses, angular_impulses) ;
+}
+
+void World::setJointGains(const float *kp, const float *kd) {
+    impl_->setJointGains(kp, kd) ;
+}
+
+void World::setJointTargets(const float *q, const float *qd) {
+    impl_->setJointTargets(q, qd) ;
+}
+
+void World::setJointTorqueLimits(const float *max_torque) {
+    impl_->setJointTorqueLimits(max_torque) ;
+}
+
+void World::getPoses(float *poses) const {
+    impl_->getPoses(poses) ;
+}
+
+size_t World::numSubSteps() const {
+    return impl_->n_sub_steps_ ;
+}
+
+float World::subStepSize() const {
+    return impl_->sub_step_ ;
+}
+
+size_t World::numCollisionShapes() const {
+    return impl_->shapes().numShapes() ;
+}
+
+size_t World::numSharedCollisionShapes() const {
+    return impl_->shapes().numDeduplicated() ;
+}
+
+void World::rayCastBatch(size_t n, const float *origins, const float *directions, float max_dist, float *out_distances, float *out_normals, int *out_bodies) const {
+    impl_->rayCastBatch(n, origins, directions, max_dist, out_distances, out_normals, out_bodies) ;
+}
+
+ContactStream &World::enableContactEvents(const ContactFilter &filter, size_t capacity) {
+    return impl_->enableContactEvents(filter, capacity) ;
+}
+
+void World::disableContactEvents() {
+    impl_->disableContactEvents() ;
+}
+
+ContactStream *World::contactStream() const {
+    return impl_->contactStream() ;
+}
+
+StepProfiler &World::enableProfiling(size_t capacity) {
+    return impl_->enableProfiling(capacity) ;
+}
+
+void World::disableProfiling() {
+    impl_->disableProfiling() ;
+}
+
+StepProfiler *World::profiler() const {
+    return impl_->profiler() ;
+}
+
+size_t World::numJoints() const {
+    return impl_->numJoints() ;
+}
+
+int World::findJoint(const string &id) const {
+    return impl_->findJoint(id) ;
+}
+
+void World::getJointPositions(float *q) const {
+    impl_->getJointPositions(q) ;
+}
+
+void World::getJointVelocities(float *qd) const {
+    impl_->getJointVelocities(qd) ;
+}
+
+void World::setJointTorques(const float *tau) {
+    impl_->setJointTorques(tau) ;
+}
+
+World::SnapshotHandle World::snapshot() {
+    return impl_->snapshot() ;
+}
+
+void World::restore(SnapshotHandle handle) {
+    impl_->restore(handle) ;
+}
+
+void World::releaseSnapshot(SnapshotHandle handle) {
+    impl_->releaseSnapshot(handle) ;
+}
+
+void World::reserveSnapshots(size_t n) {
+    impl_->reserveSnapshots(n) ;
+}
+
+}}
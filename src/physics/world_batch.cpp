@@ -0,0 +1,62 @@
+#include <vsim/physics/world_batch.hpp>
+#include "world_impl.hpp"
+
+#include <vsim/env/physics_scene.hpp>
+
+using namespace std ;
+
+namespace vsim { namespace physics {
+
+const size_t WorldBatch::ACTION_SIZE ;
+const size_t WorldBatch::STATE_SIZE ;
+
+WorldBatch::WorldBatch(const PhysicsScenePtr &scene, size_t n_worlds, const WorldConfig &config, size_t n_threads):
+    shapes_(new ShapeLibrary(scene, config)), own_pool_(n_threads ? new util::ThreadPool(n_threads) : nullptr),
+    pool_(own_pool_ ? *own_pool_ : util::ThreadPool::instance()) {
+
+    // The replicas are already stepped in parallel. A multithreaded world stepped from a task of the pool would run the
+    // nested loops of Bullet serially, and all replicas would share its global task scheduler and per-thread storage.
+    WorldConfig world_config = config ;
+    world_config.multithreaded_ = false ;
+
+    worlds_.resize(n_worlds) ;
+
+    // each world allocates its own bodies, broadphase and solver so build them on the thread that will step them
+    pool_.parallelFor(n_worlds, [&](size_t i) {
+        worlds_[i].reset(new WorldImpl(scene, world_config, shapes_, false)) ;
+    }) ;
+
+    n_bodies_ = worlds_.empty() ? 0 : worlds_[0]->bodies_.size() ;
+}
+
+WorldBatch::~WorldBatch() {
+}
+
+void WorldBatch::step(const float *actions, float *out_states, float dt) {
+
+    const size_t action_stride = n_bodies_ * ACTION_SIZE ;
+    const size_t state_stride = n_bodies_ * STATE_SIZE ;
+
+    pool_.parallelFor(worlds_.size(), [&](size_t i) {
+        WorldImpl &world = *worlds_[i] ;
+
+        if ( actions )
+            world.applyActions(actions + i * action_stride) ;
+
+        world.step(dt) ;
+
+        if ( out_states )
+            world.getState(out_states + i * state_stride) ;
+    }) ;
+}
+
+void WorldBatch::getStates(float *states) const {
+
+    const size_t state_stride = n_bodies_ * STATE_SIZE ;
+
+    pool_.parallelFor(worlds_.size(), [&](size_t i) {
+        worlds_[i]->getState(states + i * state_stride) ;
+    }) ;
+}
+
+}}
@@ -0,0 +1,904 @@
+#include "world_impl.hpp"
+#include "bullet_tools.hpp"
+#include "task_scheduler.hpp"
+
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/rigid_body_constraint.hpp>
+#include <vsim/env/node.hpp>
+#include <vsim/env/frame.hpp>
+
+#include <vsim/util/format.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std ;
+using namespace Eigen ;
+
+namespace vsim { namespace physics {
+
+WorldImpl::WorldImpl(const PhysicsScenePtr &scene, const WorldConfig &config, const ShapeLibraryPtr &shapes, bool sync_scene):
+    scene_(scene), config_(config), shapes_(shapes), sync_scene_(sync_scene) {
+
+    const AdaptiveSteppingParams &params = config_.adaptive_stepping_ ;
+    sub_step_ = params.enabled_ ? std::min(std::max(config_.time_step_, params.min_time_step_), params.max_time_step_) : config_.time_step_ ;
+
+    createDynamicsWorld() ;
+
+    if ( !shapes_ )
+        shapes_.reset(new ShapeLibrary(scene_, config_)) ;
+
+    createBodies() ;
+}
+
+WorldImpl::~WorldImpl() {
+    // the world keeps pointers to the objects so remove them before they are deleted
+
+    for( auto &c: constraints_ )
+        dynamics_world_->removeConstraint(c.get()) ;
+
+    for( auto &rb: rigid_bodies_ )
+        dynamics_world_->removeRigidBody(rb.get()) ;
+
+    for( auto &c: multi_body_constraints_ )
+        multi_body_world_->removeMultiBodyConstraint(c.get()) ;
+
+    for( auto &col: link_colliders_ )
+        dynamics_world_->removeCollisionObject(col.get()) ;
+
+    for( auto &mb: multi_bodies_ )
+        multi_body_world_->removeMultiBody(mb.get()) ;
+}
+
+void WorldImpl::createBroadphase() {
+
+    if ( config_.broadphase_ == Broadphase::SWEEP_AND_PRUNE ) {
+        // the proxies are preallocated so count the bodies in advance
+        size_t n_bodies = scene_->bodies_.size() ;
+        for( const PhysicsModelPtr &m: scene_->models_ )
+            n_bodies += m->bodies_.size() ;
+
+        btVector3 world_min = toBullet(config_.world_min_), world_max = toBullet(config_.world_max_) ;
+
+        // 16-bit quantization is enough for most scenes but limits the number of proxies
+        if ( n_bodies < 16000 )
+            broadphase_interface_.reset(new btAxisSweep3(world_min, world_max, 16384)) ;
+        else
+            broadphase_interface_.reset(new bt32BitAxisSweep3(world_min, world_max, n_bodies + 1)) ;
+    } else
+        broadphase_interface_.reset(new btDbvtBroadphase()) ;
+}
+
+void WorldImpl::createDynamicsWorld() {
+
+    createBroadphase() ;
+
+    if ( config_.multibody_ ) {
+        // there is no multithreaded multibody world
+        collision_conf_.reset(new btDefaultCollisionConfiguration()) ;
+        collision_dispatcher_.reset(new btCollisionDispatcher(collision_conf_.get())) ;
+
+        btMultiBodyConstraintSolver *solver = new btMultiBodyConstraintSolver() ;
+        solver_.reset(solver) ;
+
+        multi_body_world_ = new btMultiBodyDynamicsWorld(collision_dispatcher_.get(), broadphase_interface_.get(), solver, collision_conf_.get()) ;
+        dynamics_world_.reset(multi_body_world_) ;
+    } else if ( config_.multithreaded_ ) {
+        TaskScheduler::install() ;
+
+        // pools are shared by all threads so make them larger than the defaults
+        btDefaultCollisionConstructionInfo cci ;
+        cci.m_defaultMaxPersistentManifoldPoolSize = 80000 ;
+        cci.m_defaultMaxCollisionAlgorithmPoolSize = 80000 ;
+
+        collision_conf_.reset(new btDefaultCollisionConfiguration(cci)) ;
+        collision_dispatcher_.reset(new btCollisionDispatcherMt(collision_conf_.get())) ;
+        solver_pool_.reset(new btConstraintSolverPoolMt(btGetTaskScheduler()->getNumThreads())) ;
+
+#if BT_BULLET_VERSION >= 288
+        dynamics_world_.reset(new btDiscreteDynamicsWorldMt(collision_dispatcher_.get(), broadphase_interface_.get(),
+                                                            solver_pool_.get(), nullptr, collision_conf_.get())) ;
+#else
+        dynamics_world_.reset(new btDiscreteDynamicsWorldMt(collision_dispatcher_.get(), broadphase_interface_.get(),
+                                                            solver_pool_.get(), collision_conf_.get())) ;
+#endif
+    } else {
+        collision_conf_.reset(new btDefaultCollisionConfiguration()) ;
+        collision_dispatcher_.reset(new btCollisionDispatcher(collision_conf_.get())) ;
+        solver_.reset(new btSequentialImpulseConstraintSolver()) ;
+
+        dynamics_world_.reset(new btDiscreteDynamicsWorld(collision_dispatcher_.get(), broadphase_interface_.get(),
+                                                          solver_.get(), collision_conf_.get())) ;
+    }
+
+    dynamics_world_->setGravity(toBullet(config_.gravity_)) ;
+
+    // work done around every internal step (joint controllers, multibody impulses, contact events)
+    dynamics_world_->setInternalTickCallback(&WorldImpl::preTick, this, true) ;
+    dynamics_world_->setInternalTickCallback(&WorldImpl::postTick, this, false) ;
+}
+
+void WorldImpl::createBodies() {
+
+    createOverlapFilter() ;
+
+    for( const RigidBodyPtr &b: scene_->bodies_ )
+        createBody(b) ;
+
+    // with multibodies enabled models with constraints are built in reduced coordinates
+
+    for( const PhysicsModelPtr &m: scene_->models_ ) {
+        if ( multi_body_world_ && !m->constraints_.empty() )
+            createMultiBody(m) ;
+        else {
+            for( const RigidBodyPtr &b: m->bodies_ )
+                createBody(b) ;
+        }
+    }
+
+    for( const PhysicsModelPtr &m: scene_->models_ ) {
+        if ( !multi_body_world_ || m->constraints_.empty() )
+            createConstraints(m->constraints_) ;
+    }
+
+    createConstraints(scene_->constraints_) ;
+
+    active_bodies_.reserve(bodies_.size()) ;
+
+    link_linear_velocities_.resize(bodies_.size(), btVector3(0, 0, 0)) ;
+    link_angular_velocities_.resize(bodies_.size(), btVector3(0, 0, 0)) ;
+    updateMultiBodies() ;
+}
+
+void WorldImpl::createOverlapFilter() {
+
+    // bodies are created in the order of the scene, free bodies first and then the bodies of each model
+
+    size_t n_free = scene_->bodies_.size() ;
+    bool needed = false ;
+
+    overlap_filter_.models_.assign(n_free, -1) ;
+
+    for( size_t m=0 ; m<scene_->models_.size() ; m++ ) {
+        const PhysicsModelPtr &model = scene_->models_[m] ;
+        overlap_filter_.models_.resize(overlap_filter_.models_.size() + model->bodies_.size(), model->self_collisions_ ? -1 : (int)m) ;
+        needed = needed || !model->self_collisions_ ;
+    }
+
+    // the group and mask test of the default filter is also done by ours so only install it when models need it
+    if ( needed )
+        dynamics_world_->getPairCache()->setOverlapFilterCallback(&overlap_filter_) ;
+}
+
+bool WorldImpl::OverlapFilter::needBroadphaseCollision(btBroadphaseProxy *p0, btBroadphaseProxy *p1) const {
+    if ( !( p0->m_collisionFilterGroup & p1->m_collisionFilterMask ) || !( p1->m_collisionFilterGroup & p0->m_collisionFilterMask ) )
+        return false ;
+
+    int a = static_cast<const btCollisionObject *>(p0->m_clientObject)->getUserIndex() ;
+    int b = static_cast<const btCollisionObject *>(p1->m_clientObject)->getUserIndex() ;
+
+    return models_[a] < 0 || models_[a] != models_[b] ;
+}
+
+void WorldImpl::createBody(const RigidBodyPtr &body) {
+
+    btCollisionShape *shape = shapes_->find(body.get()) ;
+
+    btVector3 inertia(0, 0, 0) ;
+    if ( !body->isStatic() )
+        shape->calculateLocalInertia(body->mass_, inertia) ;
+
+    btRigidBody::btRigidBodyConstructionInfo info(body->mass_, nullptr, shape, inertia) ;
+    info.m_startWorldTransform = toBullet(Affine3f(body->pose_.absolute())) ;
+
+    btRigidBody *rb = new btRigidBody(info) ;
+    rigid_bodies_.emplace_back(rb) ;
+
+    rb->setLinearVelocity(toBullet(body->velocity_)) ;
+    rb->setAngularVelocity(toBullet(body->angular_velocity_)) ;
+    rb->setUserIndex(bodies_.size()) ;
+
+    if ( config_.continuous_collision_ && !body->isStatic() )
+        setupContinuousCollision(rb, *body) ;
+
+    int group, mask ;
+    ShapeLibrary::collisionFilter(*body, rb->isStaticOrKinematicObject(), group, mask) ;
+    dynamics_world_->addRigidBody(rb, group, mask) ;
+
+    if ( !body->id_.empty() )
+        body_index_[body->id_] = bodies_.size() ;
+
+    body_map_[body.get()] = bodies_.size() ;
+    bodies_.push_back({rb, rb, body.get(), nullptr, -1, true}) ;
+}
+
+// Distance from the origin of the body frame to the surface of a convex shape placed at tr, estimated from the support planes
+// along the axes, face diagonals and corner diagonals (exact for boxes and spheres centered on the origin, an overestimate
+// bounded by the margin otherwise). Zero if the origin is outside the shape.
+
+static float origin_depth(const btConvexShape *shape, const btTransform &tr) {
+
+    float depth = BT_LARGE_FLOAT ;
+
+    for( int x=-1 ; x<=1 ; x++ )
+        for( int y=-1 ; y<=1 ; y++ )
+            for( int z=-1 ; z<=1 ; z++ ) {
+                if ( x == 0 && y == 0 && z == 0 ) continue ;
+
+                btVector3 d = btVector3(x, y, z).normalized() ;
+                btVector3 support = tr * shape->localGetSupportingVertex(tr.getBasis().transpose() * d) ;
+                depth = std::min<float>(depth, support.dot(d)) ;
+            }
+
+    return std::max(depth, 0.f) ;
+}
+
+// The swept sphere is centered on the body origin, so it is sized by the convex shape or compound child containing the origin.
+// Bodies whose origin lies outside all their convex parts (e.g. offset shapes, meshes) get no automatic setting.
+
+static float origin_thickness(const btCollisionShape *shape) {
+
+    btTransform identity ;
+    identity.setIdentity() ;
+
+    if ( shape->isConvex() )
+        return origin_depth(static_cast<const btConvexShape *>(shape), identity) ;
+
+    float thickness = 0 ;
+
+    if ( shape->isCompound() ) {
+        const btCompoundShape *compound = static_cast<const btCompoundShape *>(shape) ;
+
+        for( int i=0 ; i<compound->getNumChildShapes() ; i++ ) {
+            const btCollisionShape *child = compound->getChildShape(i) ;
+            if ( child->isConvex() )
+                thickness = std::max(thickness, origin_depth(static_cast<const btConvexShape *>(child), compound->getChildTransform(i))) ;
+        }
+    }
+
+    return thickness ;
+}
+
+void WorldImpl::setupContinuousCollision(btRigidBody *rb, const RigidBody &body) {
+
+    float radius = body.ccd_swept_sphere_radius_, threshold = body.ccd_motion_threshold_ ;
+
+    if ( radius < 0 || threshold < 0 ) {
+        // the depth of the body origin approximates the thickness of the body, tunneling is only possible when a step
+        // moves the body further than that
+        float thickness = origin_thickness(rb->getCollisionShape()) ;
+
+        // the swept sphere should fit inside the body
+        if ( radius < 0 ) radius = 0.8f * thickness ;
+        if ( threshold < 0 ) threshold = thickness ;
+    }
+
+    if ( threshold <= 0 || radius <= 0 ) return ;
+
+    rb->setCcdMotionThreshold(threshold) ;
+    rb->setCcdSweptSphereRadius(radius) ;
+}
+
+btRigidBody *WorldImpl::findRigidBody(const RigidBodyPtr &body) const {
+    if ( !body ) return nullptr ;
+    auto it = body_map_.find(body.get()) ;
+    if ( it == body_map_.end() ) return nullptr ;
+    return bodies_[it->second].rb_ ;
+}
+
+btVector3 WorldImpl::pointVelocity(const btCollisionObject *obj, const btVector3 &p) const {
+    if ( const btRigidBody *rb = btRigidBody::upcast(obj) )
+        return rb->getVelocityInLocalPoint(p - rb->getCenterOfMassPosition()) ;
+
+    size_t idx = obj->getUserIndex() ;
+    return link_linear_velocities_[idx] + link_angular_velocities_[idx].cross(p - obj->getWorldTransform().getOrigin()) ;
+}
+
+void WorldImpl::createConstraints(const vector<RigidBodyConstraintPtr> &constraints) {
+
+    for( const RigidBodyConstraintPtr &c: constraints ) {
+        btRigidBody *a = findRigidBody(c->a_), *b = findRigidBody(c->b_) ;
+
+        if ( ( c->a_ && body_map_.count(c->a_.get()) && !a ) || ( c->b_ && body_map_.count(c->b_.get()) && !b ) )
+            throw PhysicsException(util::format("constraint \"%\" refers to a body of a multibody", c->id_)) ;
+
+        if ( !a )
+            throw PhysicsException(util::format("constraint \"%\" refers to a body that is not part of the scene", c->id_)) ;
+
+        btTypedConstraint *constraint = nullptr ;
+
+        if ( const HingeConstraint *hc = dynamic_cast<const HingeConstraint *>(c.get()) ) {
+            btHingeConstraint *hinge ;
+
+            if ( b )
+                hinge = new btHingeConstraint(*a, *b, toBullet(hc->pivot_a_), toBullet(hc->pivot_b_),
+                                              toBullet(hc->axis_a_), toBullet(hc->axis_b_)) ;
+            else
+                hinge = new btHingeConstraint(*a, toBullet(hc->pivot_a_), toBullet(hc->axis_a_)) ;
+
+            hinge->setLimit(hc->min_angle_, hc->max_angle_) ;
+            constraint = hinge ;
+
+            if ( !hc->id_.empty() )
+                joint_index_[hc->id_] = joints_.size() ;
+            joints_.push_back({nullptr, -1, hinge}) ;
+        } else
+            throw PhysicsException(util::format("unsupported type of constraint \"%\"", c->id_)) ;
+
+        constraints_.emplace_back(constraint) ;
+
+        // linked bodies do not collide with each other
+        dynamics_world_->addConstraint(constraint, true) ;
+    }
+}
+
+int WorldImpl::findBody(const string &id) const {
+    auto it = body_index_.find(id) ;
+    if ( it == body_index_.end() ) return -1 ;
+    return it->second ;
+}
+
+void WorldImpl::step(float dt) {
+    if ( dt <= 0 ) dt = config_.time_step_ ;
+
+    if ( profiler_ ) beginProfile() ;
+
+    tick_time_ = time_ ;
+
+    if ( config_.adaptive_stepping_.enabled_ )
+        n_sub_steps_ = stepAdaptive(dt) ;
+    else
+        n_sub_steps_ = dynamics_world_->stepSimulation(dt, config_.max_sub_steps_, config_.time_step_) ;
+
+    if ( profiler_ ) endSimulationProfile() ;
+
+    time_ += dt ;
+
+    updateLinkVelocities() ;
+
+    if ( sync_scene_ )
+        syncBodies() ;
+
+    if ( profiler_ ) endProfile() ;
+}
+
+void WorldImpl::preTick(btDynamicsWorld *world, btScalar h) {
+    WorldImpl *impl = static_cast<WorldImpl *>(world->getWorldUserInfo()) ;
+
+    if ( impl->joint_control_enabled_ ) impl->updateJointControllers(h) ;
+    if ( impl->pending_impulses_.size() ) impl->applyPendingImpulses(h) ;
+}
+
+void WorldImpl::postTick(btDynamicsWorld *world, btScalar h) {
+    WorldImpl *impl = static_cast<WorldImpl *>(world->getWorldUserInfo()) ;
+
+    impl->tick_time_ += h ;
+
+    if ( impl->joint_control_enabled_ ) impl->removeJointControllerTorques() ;
+    if ( impl->pending_impulses_.size() ) impl->removePendingImpulses() ;
+    if ( impl->contact_stream_ && !impl->defer_contacts_ ) impl->collectContacts(impl->tick_time_) ;
+}
+
+size_t WorldImpl::stepAdaptive(float dt) {
+
+    typedef chrono::steady_clock clock ;
+
+    const AdaptiveSteppingParams &params = config_.adaptive_stepping_ ;
+    auto start = clock::now() ;
+
+    float remaining = dt ;
+    size_t n_steps = 0, n_trials = 0 ;
+    bool refined = false ;  // the last step was rejected or is still above the tolerance at the minimum step size
+
+    // Each step is taken from a saved state: if its error exceeds the tolerance it is rejected and taken again at half the
+    // size, so that the steps are refined at the impact and not after it.
+
+    size_t trial = snapshot() ;
+    defer_contacts_ = true ;
+
+    while ( remaining > 1.0e-6f * dt ) {
+        float h = sub_step_ ;
+
+        // Coarsen the steps if the rest would not fit in the budget at the average cost of the steps taken so far, unless
+        // the error asks for smaller steps.
+        if ( params.budget_ > 0 && n_trials > 0 && !refined ) {
+            double elapsed = chrono::duration<double>(clock::now() - start).count() ;
+            double cost = elapsed/n_trials, left = params.budget_ - elapsed ;
+            double affordable = std::max(std::floor(left/cost), 1.0) ;
+            h = std::max(h, std::min<float>(remaining/affordable, params.max_time_step_)) ;
+        }
+
+        // do not leave a sliver at the end
+        if ( remaining < 1.25f * h ) h = remaining ;
+
+        bool rejected = false ;
+        float error ;
+
+        // nothing to retry at the minimum step size
+        bool retry = h > params.min_time_step_ ;
+        if ( retry ) saveTrial(trial) ;
+
+        while ( true ) {
+            // a single variable step of size h
+            dynamics_world_->stepSimulation(h, 0) ;
+            ++n_trials ;
+
+            float penetration, velocity ;
+            updateLinkVelocities() ;
+            measureContacts(penetration, velocity) ;
+
+            error = std::max(penetration, velocity * h)/params.max_penetration_ ;
+
+            if ( error <= 1.f || !retry ) break ;
+
+            restoreTrial(trial) ;
+            h = std::max(h * 0.5f, params.min_time_step_) ;
+            retry = h > params.min_time_step_ ;
+            rejected = true ;
+        }
+
+        remaining -= h ;
+        ++n_steps ;
+
+        if ( contact_stream_ ) collectContacts(tick_time_) ;
+
+        if ( error > 1.f )
+            sub_step_ = params.min_time_step_ ;
+        else if ( rejected )
+            sub_step_ = std::min(sub_step_, h) ;
+        else if ( error < 0.25f )
+            sub_step_ = std::min(sub_step_ * 1.25f, params.max_time_step_) ;
+
+        refined = rejected || error > 1.f ;
+    }
+
+    defer_contacts_ = false ;
+    releaseSnapshot(trial) ;
+
+    return n_steps ;
+}
+
+void WorldImpl::saveTrial(size_t handle) {
+
+    saveState(handle) ;
+
+    // the slot keeps the end time of the last internal step instead of the time of the step
+    snapshot_time_[handle] = tick_time_ ;
+
+    trial_forces_.resize(2 * bodies_.size()) ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const Body &b = bodies_[i] ;
+        btVector3 &f = trial_forces_[2*i], &t = trial_forces_[2*i+1] ;
+
+        if ( b.isStatic() ) {
+            f.setZero() ; t.setZero() ;
+        } else if ( b.rb_ ) {
+            f = b.rb_->getTotalForce() ; t = b.rb_->getTotalTorque() ;
+        } else if ( b.link_ < 0 ) {
+            f = b.mb_->getBaseForce() ; t = b.mb_->getBaseTorque() ;
+        } else {
+            f = b.mb_->getLinkForce(b.link_) ; t = b.mb_->getLinkTorque(b.link_) ;
+        }
+    }
+
+    trial_impulses_ = pending_impulses_ ;
+}
+
+void WorldImpl::restoreTrial(size_t handle) {
+
+    // the forces are cleared with the state
+    restoreState(handle) ;
+    tick_time_ = snapshot_time_[handle] ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ )
+        applyForce(bodies_[i], trial_forces_[2*i], trial_forces_[2*i+1]) ;
+
+    pending_impulses_ = trial_impulses_ ;
+}
+
+void WorldImpl::measureContacts(float &max_penetration, float &max_velocity) const {
+
+    max_penetration = max_velocity = 0 ;
+
+    btDispatcher *dispatcher = dynamics_world_->getDispatcher() ;
+
+    for( int i=0 ; i<dispatcher->getNumManifolds() ; i++ ) {
+        const btPersistentManifold *manifold = dispatcher->getManifoldByIndexInternal(i) ;
+        const btCollisionObject *a = manifold->getBody0(), *b = manifold->getBody1() ;
+
+        for( int k=0 ; k<manifold->getNumContacts() ; k++ ) {
+            const btManifoldPoint &cp = manifold->getContactPoint(k) ;
+
+            max_penetration = std::max<float>(max_penetration, -cp.getDistance()) ;
+
+            // the normal points from b to a so approaching bodies have negative relative normal velocity
+            btVector3 va = pointVelocity(a, cp.getPositionWorldOnA()), vb = pointVelocity(b, cp.getPositionWorldOnB()) ;
+
+            max_velocity = std::max<float>(max_velocity, -( va - vb ).dot(cp.m_normalWorldOnB)) ;
+        }
+    }
+}
+
+void WorldImpl::syncBodies(bool all) {
+
+    // single pass over the flat body table, no allocations or reference counting here
+
+    active_bodies_.clear() ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        Body &b = bodies_[i] ;
+        if ( b.isStatic() ) continue ;
+
+        // a body put to sleep in this step gets its final pose and zero velocity written once more
+        bool active = b.isAwake() ;
+        if ( !all && !active && !b.active_ ) continue ;
+        b.active_ = active ;
+
+        RigidBody *body = b.body_ ;
+        fromBullet(b.co_->getWorldTransform(), body->pose_.mat_) ;
+
+        // bodies were placed by their absolute pose, the pose of a body in a frame stays relative to the frame
+        if ( body->pose_.frame_ )
+            body->pose_.mat_ = Affine3f(body->pose_.frame_->transform()).inverse() * body->pose_.mat_ ;
+
+        fromBullet(linearVelocity(i), body->velocity_) ;
+        fromBullet(angularVelocity(i), body->angular_velocity_) ;
+
+        if ( body->visual_ )
+            body->visual_->pose_.mat_ = body->pose_.mat_ ;
+
+        active_bodies_.push_back(i) ;
+    }
+}
+
+void WorldImpl::getState(float *state) const {
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const btTransform &tr = bodies_[i].co_->getWorldTransform() ;
+        const btVector3 &p = tr.getOrigin(), &v = linearVelocity(i), &w = angularVelocity(i) ;
+        btQuaternion q = tr.getRotation() ;
+
+        *state++ = p.x() ; *state++ = p.y() ; *state++ = p.z() ;
+        *state++ = q.x() ; *state++ = q.y() ; *state++ = q.z() ; *state++ = q.w() ;
+        *state++ = v.x() ; *state++ = v.y() ; *state++ = v.z() ;
+        *state++ = w.x() ; *state++ = w.y() ; *state++ = w.z() ;
+    }
+}
+
+void WorldImpl::getPoses(float *poses) const {
+
+    size_t n = bodies_.size() ;
+
+    for( size_t i=0 ; i<n ; i++ ) {
+        const btTransform &tr = bodies_[i].co_->getWorldTransform() ;
+        const btVector3 &p = tr.getOrigin() ;
+        btQuaternion q = tr.getRotation() ;
+
+        poses[i] = p.x() ; poses[n + i] = p.y() ; poses[2*n + i] = p.z() ;
+        poses[3*n + i] = q.x() ; poses[4*n + i] = q.y() ; poses[5*n + i] = q.z() ; poses[6*n + i] = q.w() ;
+    }
+}
+
+void WorldImpl::applyForce(Body &b, const btVector3 &f, const btVector3 &t) {
+
+    if ( b.isStatic() ) return ;
+    if ( f.isZero() && t.isZero() ) return ;
+
+    if ( btRigidBody *rb = b.rb_ ) {
+        rb->activate() ;
+        rb->applyCentralForce(f) ;
+        rb->applyTorque(t) ;
+    } else if ( b.link_ < 0 ) {
+        b.mb_->wakeUp() ;
+        b.mb_->addBaseForce(f) ;
+        b.mb_->addBaseTorque(t) ;
+    } else {
+        b.mb_->wakeUp() ;
+        b.mb_->addLinkForce(b.link_, f) ;
+        b.mb_->addLinkTorque(b.link_, t) ;
+    }
+}
+
+void WorldImpl::applyActions(const float *actions) {
+
+    for( Body &b: bodies_ ) {
+        applyForce(b, btVector3(actions[0], actions[1], actions[2]), btVector3(actions[3], actions[4], actions[5])) ;
+        actions += 6 ;
+    }
+}
+
+void WorldImpl::getStates(float *pos, float *quat, float *linvel, float *angvel) const {
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const btTransform &tr = bodies_[i].co_->getWorldTransform() ;
+
+        if ( pos ) {
+            const btVector3 &p = tr.getOrigin() ;
+            *pos++ = p.x() ; *pos++ = p.y() ; *pos++ = p.z() ;
+        }
+
+        if ( quat ) {
+            btQuaternion q = tr.getRotation() ;
+            *quat++ = q.x() ; *quat++ = q.y() ; *quat++ = q.z() ; *quat++ = q.w() ;
+        }
+
+        if ( linvel ) {
+            const btVector3 &v = linearVelocity(i) ;
+            *linvel++ = v.x() ; *linvel++ = v.y() ; *linvel++ = v.z() ;
+        }
+
+        if ( angvel ) {
+            const btVector3 &w = angularVelocity(i) ;
+            *angvel++ = w.x() ; *angvel++ = w.y() ; *angvel++ = w.z() ;
+        }
+    }
+}
+
+void WorldImpl::applyForces(const float *forces, const float *torques) {
+
+    const btVector3 zero(0, 0, 0) ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        btVector3 f = forces ? btVector3(forces[3*i], forces[3*i+1], forces[3*i+2]) : zero ;
+        btVector3 t = torques ? btVector3(torques[3*i], torques[3*i+1], torques[3*i+2]) : zero ;
+        applyForce(bodies_[i], f, t) ;
+    }
+}
+
+void WorldImpl::applyImpulses(const float *impulses, const float *angular_impulses) {
+
+    const btVector3 zero(0, 0, 0) ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        Body &b = bodies_[i] ;
+
+        btVector3 j = impulses ? btVector3(impulses[3*i], impulses[3*i+1], impulses[3*i+2]) : zero ;
+        btVector3 h = angular_impulses ? btVector3(angular_impulses[3*i], angular_impulses[3*i+1], angular_impulses[3*i+2]) : zero ;
+
+        if ( b.isStatic() ) continue ;
+        if ( j.isZero() && h.isZero() ) continue ;
+
+        if ( btRigidBody *rb = b.rb_ ) {
+            rb->activate() ;
+            rb->applyCentralImpulse(j) ;
+            rb->applyTorqueImpulse(h) ;
+        } else {
+            b.mb_->wakeUp() ;
+            pending_impulses_.push_back(PendingImpulse{i, j, h, 0}) ;
+        }
+    }
+}
+
+void WorldImpl::applyPendingImpulses(float h) {
+
+    for( int i=0 ; i<pending_impulses_.size() ; i++ ) {
+        PendingImpulse &p = pending_impulses_[i] ;
+        p.h_ = h ;
+        applyForce(bodies_[p.body_], p.impulse_ / h, p.angular_impulse_ / h) ;
+    }
+}
+
+void WorldImpl::removePendingImpulses() {
+
+    for( int i=0 ; i<pending_impulses_.size() ; i++ ) {
+        const PendingImpulse &p = pending_impulses_[i] ;
+        applyForce(bodies_[p.body_], -p.impulse_ / p.h_, -p.angular_impulse_ / p.h_) ;
+    }
+
+    pending_impulses_.clear() ;
+}
+
+// The time that the dynamics world has accumulated towards its next fixed internal step is a protected member, it is part of
+// the state since it decides when the internal steps of the following calls to stepSimulation are taken.
+
+namespace {
+struct LocalTimeAccess: btDiscreteDynamicsWorld {
+    typedef btScalar btDiscreteDynamicsWorld::*Member ;
+    static Member member() { return &LocalTimeAccess::m_localTime ; }
+};
+}
+
+size_t WorldImpl::snapshot() {
+
+    if ( free_snapshots_.empty() )
+        reserveSnapshots(std::max<size_t>(2 * snapshot_time_.size(), 4)) ;
+
+    size_t handle = free_snapshots_.back() ;
+    free_snapshots_.pop_back() ;
+    snapshot_used_[handle] = true ;
+
+    saveState(handle) ;
+    snapshot_time_[handle] = time_ ;
+
+    return handle ;
+}
+
+void WorldImpl::saveState(size_t handle) {
+
+    size_t offset = handle * bodies_.size() ;
+
+    // the state of links is given by the joints of their multibody
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const Body &b = bodies_[i] ;
+        BodyState &state = snapshot_bodies_[offset + i] ;
+
+        state.transform_ = b.co_->getWorldTransform() ;
+        state.linear_velocity_ = linearVelocity(i) ;
+        state.angular_velocity_ = angularVelocity(i) ;
+        state.deactivation_time_ = b.co_->getDeactivationTime() ;
+        state.activation_state_ = b.co_->getActivationState() ;
+    }
+
+    offset = handle * constraints_.size() ;
+
+    for( size_t i=0 ; i<constraints_.size() ; i++ )
+        snapshot_impulses_[offset + i] = constraints_[i]->internalGetAppliedImpulse() ;
+
+    // the state of hinges between rigid bodies is saved with the bodies
+
+    offset = handle * 2 * joints_.size() ;
+
+    for( size_t i=0 ; i<joints_.size() ; i++ ) {
+        if ( !joints_[i].mb_ ) continue ;
+        snapshot_joints_[offset + 2*i] = joints_[i].mb_->getJointPos(joints_[i].link_) ;
+        snapshot_joints_[offset + 2*i + 1] = joints_[i].mb_->getJointVel(joints_[i].link_) ;
+    }
+
+    btDispatcher *dispatcher = dynamics_world_->getDispatcher() ;
+    btAlignedObjectArray<ManifoldState> &manifolds = snapshot_manifolds_[handle] ;
+    manifolds.resize(0) ;
+
+    for( int i=0 ; i<dispatcher->getNumManifolds() ; i++ ) {
+        const btPersistentManifold *m = dispatcher->getManifoldByIndexInternal(i) ;
+        if ( m->getNumContacts() == 0 ) continue ;
+
+        ManifoldState &state = manifolds.expand() ;
+        state.body0_ = m->getBody0() ;
+        state.body1_ = m->getBody1() ;
+        state.n_points_ = m->getNumContacts() ;
+
+        for( int k=0 ; k<state.n_points_ ; k++ ) {
+            state.points_[k] = m->getContactPoint(k) ;
+            state.points_[k].m_userPersistentData = nullptr ;
+        }
+    }
+
+    snapshot_local_time_[handle] = dynamics_world_.get()->*LocalTimeAccess::member() ;
+}
+
+void WorldImpl::restore(size_t handle) {
+
+    if ( handle >= snapshot_used_.size() || !snapshot_used_[handle] )
+        throw PhysicsException("invalid snapshot handle") ;
+
+    restoreState(handle) ;
+
+    // forces were cleared with the state so impulses waiting for the next step are dropped with them
+    pending_impulses_.clear() ;
+
+    time_ = snapshot_time_[handle] ;
+
+    // contact events of the next step are relative to the restored contacts, not to those of the abandoned branch
+    if ( contact_stream_ ) resetContacts() ;
+
+    // sleeping bodies may have been moved by the restore
+    if ( sync_scene_ )
+        syncBodies(true) ;
+}
+
+void WorldImpl::restoreState(size_t handle) {
+
+    size_t offset = handle * bodies_.size() ;
+
+    for( size_t i=0 ; i<bodies_.size() ; i++ ) {
+        const Body &b = bodies_[i] ;
+        if ( b.isStatic() ) continue ;
+
+        const BodyState &state = snapshot_bodies_[offset + i] ;
+
+        if ( !b.rb_ ) {
+            if ( b.link_ < 0 ) {
+                b.mb_->setBasePos(state.transform_.getOrigin()) ;
+                b.mb_->setWorldToBaseRot(state.transform_.getRotation().inverse()) ;
+                b.mb_->setBaseVel(state.linear_velocity_) ;
+                b.mb_->setBaseOmega(state.angular_velocity_) ;
+                b.mb_->clearForcesAndTorques() ;
+                if ( state.activation_state_ == ISLAND_SLEEPING ) b.mb_->goToSleep() ;
+                else b.mb_->wakeUp() ;
+            }
+            continue ;
+        }
+
+        btRigidBody *rb = b.rb_ ;
+
+        rb->setWorldTransform(state.transform_) ;
+        rb->setInterpolationWorldTransform(state.transform_) ;
+        rb->setLinearVelocity(state.linear_velocity_) ;
+        rb->setAngularVelocity(state.angular_velocity_) ;
+        rb->setInterpolationLinearVelocity(state.linear_velocity_) ;
+        rb->setInterpolationAngularVelocity(state.angular_velocity_) ;
+        rb->clearForces() ;
+        rb->forceActivationState(state.activation_state_) ;
+        rb->setDeactivationTime(state.deactivation_time_) ;
+    }
+
+    offset = handle * constraints_.size() ;
+
+    for( size_t i=0 ; i<constraints_.size() ; i++ )
+        constraints_[i]->internalSetAppliedImpulse(snapshot_impulses_[offset + i]) ;
+
+    offset = handle * 2 * joints_.size() ;
+
+    for( size_t i=0 ; i<joints_.size() ; i++ ) {
+        if ( !joints_[i].mb_ ) continue ;
+        joints_[i].mb_->setJointPos(joints_[i].link_, snapshot_joints_[offset + 2*i]) ;
+        joints_[i].mb_->setJointVel(joints_[i].link_, snapshot_joints_[offset + 2*i + 1]) ;
+    }
+
+    updateMultiBodies() ;
+
+    // Contact points cached in the manifolds refer to the state before the restore, they are replaced by the points saved
+    // for the same pair. Manifolds usually keep their order so the saved ones are searched from the last match, which
+    // also pairs up the manifolds of compound shapes. Pairs whose manifold has been destroyed since the snapshot lose
+    // their points.
+
+    btDispatcher *dispatcher = dynamics_world_->getDispatcher() ;
+    const btAlignedObjectArray<ManifoldState> &manifolds = snapshot_manifolds_[handle] ;
+    int n_saved = manifolds.size(), next = 0 ;
+
+    for( int i=0 ; i<dispatcher->getNumManifolds() ; i++ ) {
+        btPersistentManifold *m = dispatcher->getManifoldByIndexInternal(i) ;
+        m->clearManifold() ;
+
+        for( int k=0 ; k<n_saved ; k++ ) {
+            const ManifoldState &state = manifolds[( next + k ) % n_saved] ;
+            if ( state.body0_ != m->getBody0() || state.body1_ != m->getBody1() ) continue ;
+
+            m->setNumContacts(state.n_points_) ;
+            for( int p=0 ; p<state.n_points_ ; p++ )
+                m->getContactPoint(p) = state.points_[p] ;
+
+            next = ( next + k + 1 ) % n_saved ;
+            break ;
+        }
+    }
+
+    dynamics_world_.get()->*LocalTimeAccess::member() = snapshot_local_time_[handle] ;
+}
+
+void WorldImpl::releaseSnapshot(size_t handle) {
+
+    if ( handle >= snapshot_used_.size() || !snapshot_used_[handle] )
+        throw PhysicsException("invalid snapshot handle") ;
+
+    snapshot_used_[handle] = false ;
+    free_snapshots_.push_back(handle) ;
+}
+
+void WorldImpl::reserveSnapshots(size_t n) {
+
+    size_t n_slots = snapshot_time_.size() ;
+    if ( n <= n_slots ) return ;
+
+    snapshot_bodies_.resize(n * bodies_.size()) ;
+    snapshot_impulses_.resize(n * constraints_.size()) ;
+    snapshot_joints_.resize(n * 2 * joints_.size()) ;
+    snapshot_manifolds_.resize(n) ;
+    snapshot_local_time_.resize(n) ;
+    snapshot_time_.resize(n) ;
+    snapshot_used_.resize(n, false) ;
+
+    free_snapshots_.reserve(n) ;
+
+    // hand out lower slots first
+    for( size_t i=n ; i>n_slots ; i-- )
+        free_snapshots_.push_back(i-1) ;
+}
+
+}}
@@ -0,0 +1,292 @@
+#ifndef __VSIM_PHYSICS_WORLD_IMPL_HPP__
+#define __VSIM_PHYSICS_WORLD_IMPL_HPP__
+
+#include <memory>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <limits>
+#include <chrono>
+
+#include <btBulletDynamicsCommon.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <BulletDynamics/Featherstone/btMultiBodyDynamicsWorld.h>
+#include <BulletDynamics/Featherstone/btMultiBodyConstraint.h>
+
+#include <vsim/physics/world.hpp>
+#include <vsim/physics/contact_stream.hpp>
+#include <vsim/physics/profiler.hpp>
+#include <vsim/env/scene_fwd.hpp>
+
+#include "shape_library.hpp"
+
+namespace vsim { namespace physics {
+
+class WorldImpl {
+public:
+
+    // Creates the world using the given shape library (a new one is created if null). If sync_scene is false the bodies
+    // of the scene are never written to; this is used for replicas of the same scene simulated in parallel.
+    WorldImpl(const PhysicsScenePtr &scene, const WorldConfig &config, const ShapeLibraryPtr &shapes = nullptr, bool sync_scene = true) ;
+    ~WorldImpl() ;
+
+    void step(float dt) ;
+
+    // Copy transforms and velocities back to the scene bodies and their visual nodes. Unless all is true only bodies that are
+    // awake, or were awake in the previous sync, are written since sleeping bodies do not move. The bodies written are listed in active_bodies_.
+    void syncBodies(bool all = false) ;
+
+    // write the state of all bodies as consecutive records of (position, orientation quaternion (x, y, z, w), linear velocity, angular velocity)
+    void getState(float *state) const ;
+
+    // write the position and orientation quaternion (x, y, z, w) of all bodies
+    void getPoses(float *poses) const ;
+
+    // apply a force and torque (6 values per body) for the next step
+    void applyActions(const float *actions) ;
+
+    // structure of arrays variants, see World::getStates()
+    void getStates(float *pos, float *quat, float *linvel, float *angvel) const ;
+    void applyForces(const float *forces, const float *torques) ;
+    void applyImpulses(const float *impulses, const float *angular_impulses) ;
+
+    int findBody(const std::string &id) const ;
+
+    const ShapeLibrary &shapes() const { return *shapes_ ; }
+
+    void rayCastBatch(size_t n, const float *origins, const float *directions, float max_dist,
+                      float *out_distances, float *out_normals, int *out_bodies) const ;
+
+    ContactStream &enableContactEvents(const ContactFilter &filter, size_t capacity) ;
+    void disableContactEvents() ;
+    ContactStream *contactStream() const { return contact_stream_.get() ; }
+
+    StepProfiler &enableProfiling(size_t capacity) ;
+    void disableProfiling() ;
+    StepProfiler *profiler() const { return profiler_.get() ; }
+
+    size_t snapshot() ;
+    void restore(size_t handle) ;
+    void releaseSnapshot(size_t handle) ;
+    void reserveSnapshots(size_t n) ;
+
+    // joints of the multibodies and hinges between rigid bodies, see World::numJoints()
+    size_t numJoints() const { return joints_.size() ; }
+    int findJoint(const std::string &id) const ;
+    void getJointPositions(float *q) const ;
+    void getJointVelocities(float *qd) const ;
+    void setJointTorques(const float *tau) ;
+
+    // PD controllers evaluated before every internal step, see World::setJointGains()
+    void setJointGains(const float *kp, const float *kd) ;
+    void setJointTargets(const float *q, const float *qd) ;
+    void setJointTorqueLimits(const float *max_torque) ;
+
+    // entry of the flat body table that is traversed after each step
+    struct Body {
+        btRigidBody *rb_ ;         // null for the links of a multibody
+        btCollisionObject *co_ ;   // the rigid body or the link collider
+        RigidBody *body_ ;
+        btMultiBody *mb_ ;         // multibody and link index (-1 for the base) of articulated bodies
+        int link_ ;
+        bool active_ ;             // awake at the last sync
+
+        bool isStatic() const { return rb_ ? rb_->isStaticObject() : ( link_ < 0 && mb_->hasFixedBase() ) ; }
+        bool isAwake() const { return rb_ ? rb_->isActive() : mb_->isAwake() ; }
+    };
+
+    std::vector<Body> bodies_ ;
+    std::vector<size_t> active_bodies_ ;
+    float time_ = 0 ;
+    size_t n_sub_steps_ = 0 ;  // internal steps taken by the last step
+    float sub_step_ ;          // current internal step size
+
+private:
+
+    // advance by dt using internal steps sized by the adaptive stepping controller, returns the number of steps taken
+    size_t stepAdaptive(float dt) ;
+
+    // deepest penetration and highest approach velocity over all contact points
+    void measureContacts(float &max_penetration, float &max_velocity) const ;
+
+    void createBroadphase() ;
+    void createDynamicsWorld() ;
+    void createBodies() ;
+    void createOverlapFilter() ;
+    void createBody(const RigidBodyPtr &body) ;
+    void setupContinuousCollision(btRigidBody *rb, const RigidBody &body) ;
+    void createMultiBody(const PhysicsModelPtr &model) ;
+    void createConstraints(const std::vector<RigidBodyConstraintPtr> &constraints) ;
+
+    btRigidBody *findRigidBody(const RigidBodyPtr &body) const ;
+
+    // accumulate a force and torque on a dynamic body for the next step
+    void applyForce(Body &b, const btVector3 &f, const btVector3 &t) ;
+
+    // world space velocities of bodies and of points on them, link velocities are computed by updateLinkVelocities()
+    const btVector3 &linearVelocity(size_t idx) const { return bodies_[idx].rb_ ? bodies_[idx].rb_->getLinearVelocity() : link_linear_velocities_[idx] ; }
+    const btVector3 &angularVelocity(size_t idx) const { return bodies_[idx].rb_ ? bodies_[idx].rb_->getAngularVelocity() : link_angular_velocities_[idx] ; }
+    btVector3 pointVelocity(const btCollisionObject *obj, const btVector3 &p) const ;
+
+    // propagate base and joint velocities of the multibodies down to the links
+    void updateLinkVelocities() ;
+
+    // update the colliders and link velocities after the state of the multibodies was set directly
+    void updateMultiBodies() ;
+
+    // append the contact events of the internal step ending at simulation time t to the stream, called after each internal step
+    void collectContacts(float t) ;
+
+    // pairs in contact at time t sorted by body indices, merged and filtered into contacts_
+    void gatherContacts(float t) ;
+
+    // take the pairs in contact as those of the previous internal step without emitting events, e.g. after a restore
+    void resetContacts() ;
+
+    // profile of the current step, the phases are timed between beginProfile() and endSimulationProfile() (see profiler.cpp)
+    void beginProfile() ;
+    void endSimulationProfile() ;
+    void endProfile() ;
+
+    PhysicsScenePtr scene_ ;
+    WorldConfig config_ ;
+    ShapeLibraryPtr shapes_ ;
+    bool sync_scene_ ;
+
+    std::unique_ptr<btDefaultCollisionConfiguration> collision_conf_ ;
+    std::unique_ptr<btCollisionDispatcher> collision_dispatcher_ ;
+    std::unique_ptr<btBroadphaseInterface> broadphase_interface_ ;
+    std::unique_ptr<btConstraintSolver> solver_ ;
+    std::unique_ptr<btConstraintSolverPoolMt> solver_pool_ ;
+    std::unique_ptr<btDiscreteDynamicsWorld> dynamics_world_ ;
+    btMultiBodyDynamicsWorld *multi_body_world_ = nullptr ;  // same as dynamics_world_ if multibodies are enabled
+
+    // owned Bullet objects, these are not touched after the world is built
+    std::vector<std::unique_ptr<btRigidBody>> rigid_bodies_ ;
+    std::vector<std::unique_ptr<btTypedConstraint>> constraints_ ;
+    std::vector<std::unique_ptr<btMultiBody>> multi_bodies_ ;
+    std::vector<std::unique_ptr<btMultiBodyLinkCollider>> link_colliders_ ;
+    std::vector<std::unique_ptr<btMultiBodyConstraint>> multi_body_constraints_ ;
+
+    // bodies_ index of the base and of each link of the multibodies
+    std::vector<std::vector<size_t>> multi_body_links_ ;
+
+    // single degree of freedom joints, either a link of a multibody or a hinge constraint between rigid bodies
+    struct Joint {
+        btMultiBody *mb_ ;
+        int link_ ;
+        btHingeConstraint *hinge_ ;
+    };
+
+    std::vector<Joint> joints_ ;
+    std::map<std::string, size_t> joint_index_ ;
+
+    float jointPosition(const Joint &j) const ;
+    float jointVelocity(const Joint &j) const ;
+    void addJointTorque(const Joint &j, float t) ;
+
+    // gains, targets and torque limit of the controller of each joint
+    struct JointControl {
+        float kp_ = 0, kd_ = 0 ;
+        float q_target_ = 0, qd_target_ = 0 ;
+        float max_torque_ = std::numeric_limits<float>::infinity() ;
+        float applied_ = 0 ;  // multibody joint torque applied in the current internal step
+    };
+
+    std::vector<JointControl> joint_control_ ;
+    bool joint_control_enabled_ = false ;
+
+    void updateJointControllers(float h) ;
+    void removeJointControllerTorques() ;
+
+    // Impulses on multibody bodies, which have no impulse interface. They are applied as forces over the next internal
+    // step only and removed after it, since Bullet keeps forces for all internal steps of stepSimulation.
+    struct PendingImpulse {
+        size_t body_ ;
+        btVector3 impulse_, angular_impulse_ ;
+        btScalar h_ ;   // size of the internal step the forces were applied in, zero before
+    };
+
+    btAlignedObjectArray<PendingImpulse> pending_impulses_ ;
+
+    void applyPendingImpulses(float h) ;
+    void removePendingImpulses() ;
+
+    // Forces and impulses waiting for the next step, saved with the state before each adaptive step so that a rejected
+    // step can be taken again at a smaller size. Contact events are only collected once a step is accepted.
+    btAlignedObjectArray<btVector3> trial_forces_ ;  // force and torque of each body
+    btAlignedObjectArray<PendingImpulse> trial_impulses_ ;
+    bool defer_contacts_ = false ;
+
+    void saveTrial(size_t handle) ;
+    void restoreTrial(size_t handle) ;
+
+    // internal tick callbacks of Bullet installed with the dynamics world, the world user info is the WorldImpl
+    static void preTick(btDynamicsWorld *world, btScalar h) ;
+    static void postTick(btDynamicsWorld *world, btScalar h) ;
+
+    // world space velocities of the multibody links indexed like bodies_, unused for rigid bodies
+    btAlignedObjectArray<btVector3> link_linear_velocities_, link_angular_velocities_ ;
+    btAlignedObjectArray<btQuaternion> scratch_rotations_ ;
+    btAlignedObjectArray<btVector3> scratch_positions_ ;
+
+    // snapshot storage, each snapshot occupies a fixed size slot in the arrays below
+
+    struct BodyState {
+        btTransform transform_ ;
+        btVector3 linear_velocity_, angular_velocity_ ;
+        btScalar deactivation_time_ ;
+        int activation_state_ ;
+    };
+
+    // cached contact points of a manifold, used to warm start the solver
+    struct ManifoldState {
+        const btCollisionObject *body0_, *body1_ ;
+        int n_points_ ;
+        btManifoldPoint points_[MANIFOLD_CACHE_SIZE] ;
+    };
+
+    btAlignedObjectArray<BodyState> snapshot_bodies_ ;      // bodies_.size() entries per slot
+    std::vector<btScalar> snapshot_impulses_ ;               // constraints_.size() entries per slot
+    std::vector<btScalar> snapshot_joints_ ;                 // position and velocity of joints_ per slot
+    std::vector<btAlignedObjectArray<ManifoldState>> snapshot_manifolds_ ; // non empty manifolds of each slot
+    std::vector<btScalar> snapshot_local_time_ ;             // time accumulated by the dynamics world towards the next fixed step
+    std::vector<float> snapshot_time_ ;
+    std::vector<bool> snapshot_used_ ;
+    std::vector<size_t> free_snapshots_ ;
+
+    // save and restore the simulation state in a slot, without the time, scene and bookkeeping handled by snapshot() and restore()
+    void saveState(size_t handle) ;
+    void restoreState(size_t handle) ;
+
+    // traversal stacks of the ray casts, one for the broadphase tree and one for the trees of compound shapes per thread of the pool
+    mutable std::vector<btAlignedObjectArray<const btDbvtNode *>> ray_stacks_ ;
+    mutable std::mutex ray_mutex_ ;
+
+    // contact events, the pairs in contact are kept sorted by body indices to find the transitions between steps
+    std::unique_ptr<ContactStream> contact_stream_ ;
+    ContactFilter contact_filter_ ;
+    std::vector<uint8_t> contact_mask_ ;                  // bodies selected by the filter
+    std::vector<ContactEvent> contacts_, prev_contacts_ ;
+    float tick_time_ = 0 ;                                // end time of the last internal step
+
+    std::unique_ptr<StepProfiler> profiler_ ;
+    StepProfile profile_ ;
+    std::chrono::steady_clock::time_point profile_start_, profile_simulated_ ;
+
+    // broadphase filter applying the groups and masks of the bodies and excluding pairs within models without self collisions
+    struct OverlapFilter: public btOverlapFilterCallback {
+        bool needBroadphaseCollision(btBroadphaseProxy *p0, btBroadphaseProxy *p1) const override ;
+
+        std::vector<int> models_ ;  // index of the model of each body if its self collisions are disabled, -1 otherwise
+    };
+
+    OverlapFilter overlap_filter_ ;
+
+    std::map<const RigidBody *, size_t> body_map_ ;
+    std::map<std::string, size_t> body_index_ ;
+} ;
+
+}}
+
+#endif
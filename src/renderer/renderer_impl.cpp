@@ -168,6 +168,80 @@ void RendererImpl::initBuffersForMesh(MeshData &data, Mesh &mesh)
     glBindVertexArray(0);
 }
 
+// Heightfields share a single vertex buffer and are triangulated in square tiles of quads so that each tile may be
+// drawn (or culled) separately.
+
+void RendererImpl::initBuffersForHeightfield(MeshData &data, const HeightfieldGeometry &hf)
+{
+    const size_t tile_size = 64 ;
+
+    size_t n_cols = hf.n_cols_, n_rows = hf.n_rows_ ;
+    if ( n_cols < 2 || n_rows < 2 ) return ;
+
+    float dx = hf.size_.x()/( n_cols - 1 ), dz = hf.size_.y()/( n_rows - 1 ) ;
+    float x0 = -hf.size_.x()/2, z0 = -hf.size_.y()/2 ;
+
+    vector<Vector3f> vertices(n_cols * n_rows), normals(n_cols * n_rows) ;
+
+    for( size_t r=0 ; r<n_rows ; r++ ) {
+        for( size_t c=0 ; c<n_cols ; c++ ) {
+            vertices[r * n_cols + c] = Vector3f(x0 + c * dx, hf.height(r, c), z0 + r * dz) ;
+
+            // central differences clamped at the borders
+            size_t cl = ( c > 0 ) ? c - 1 : c, cr = std::min(c + 1, n_cols - 1) ;
+            size_t rl = ( r > 0 ) ? r - 1 : r, rr = std::min(r + 1, n_rows - 1) ;
+            float gx = ( hf.height(r, cr) - hf.height(r, cl) )/( ( cr - cl ) * dx ) ;
+            float gz = ( hf.height(rr, c) - hf.height(rl, c) )/( ( rr - rl ) * dz ) ;
+            normals[r * n_cols + c] = Vector3f(-gx, 1, -gz).normalized() ;
+        }
+    }
+
+    vector<GLuint> indices ;
+    indices.reserve(( n_cols - 1 ) * ( n_rows - 1 ) * 6) ;
+
+    for( size_t tr=0 ; tr<n_rows-1 ; tr += tile_size ) {
+        for( size_t tc=0 ; tc<n_cols-1 ; tc += tile_size ) {
+            GLuint first = indices.size() ;
+
+            for( size_t r=tr ; r<std::min(tr + tile_size, n_rows - 1) ; r++ ) {
+                for( size_t c=tc ; c<std::min(tc + tile_size, n_cols - 1) ; c++ ) {
+                    GLuint v00 = r * n_cols + c, v01 = v00 + 1, v10 = v00 + n_cols, v11 = v10 + 1 ;
+                    // counter-clockwise when seen from above
+                    indices.insert(indices.end(), { v00, v10, v01, v01, v10, v11 }) ;
+                }
+            }
+
+            data.tiles_.emplace_back(first, indices.size() - first) ;
+        }
+    }
+
+    data.elem_count_ = indices.size() ;
+
+    glGenVertexArrays(1, &data.vao_);
+    glBindVertexArray(data.vao_);
+
+    glGenBuffers(1, &data.buffers_[POS_VB]);
+    glBindBuffer(GL_ARRAY_BUFFER, data.buffers_[POS_VB]);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat) * 3, vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(POSITION_LOCATION);
+    glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    glGenBuffers(1, &data.buffers_[NORMAL_VB]);
+    glBindBuffer(GL_ARRAY_BUFFER, data.buffers_[NORMAL_VB]);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(GLfloat) * 3, normals.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(NORMALS_LOCATION);
+    glVertexAttribPointer(NORMALS_LOCATION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    // the element array binding is part of the VAO state
+    glGenBuffers(1, &data.buffers_[INDEX_BUFFER]);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data.buffers_[INDEX_BUFFER]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
 void RendererImpl::render(const Camera &cam, Renderer::RenderMode mode) {
 
     glEnable(GL_DEPTH_TEST) ;
@@ -747,7 +821,14 @@ void RendererImpl::render(const DrawablePtr &geom, const Camera &cam, const Matr
 {
     if ( !geom->geometry_ ) return ;
 
-    MeshData &data = buffers_[geom->geometry_] ;
+    auto it = buffers_.find(geom->geometry_) ;
+    if ( it == buffers_.end() ) {
+        it = buffers_.emplace(geom->geometry_, MeshData()).first ;
+        if ( HeightfieldGeometryPtr hf = std::dynamic_pointer_cast<HeightfieldGeometry>(geom->geometry_) )
+            initBuffersForHeightfield(it->second, *hf) ;
+    }
+
+    MeshData &data = it->second ;
 
     if ( mode == Renderer::RENDER_FLAT )
         prog_ = shaders_.get("rigid_flat") ;
@@ -803,7 +884,10 @@ void RendererImpl::render(const DrawablePtr &geom, const Camera &cam, const Matr
 
     MeshPtr mesh = std::dynamic_pointer_cast<Mesh>(geom->geometry_) ;
 
-    if ( mesh ) {
+    if ( !data.tiles_.empty() ) {
+        for( const auto &tile: data.tiles_ )
+            glDrawElements(GL_TRIANGLES, tile.second, GL_UNSIGNED_INT, (const GLvoid *)( tile.first * sizeof(GLuint) )) ;
+    } else if ( mesh ) {
         if ( mesh->ptype_ == Mesh::Triangles ) {
             glDrawArrays(GL_TRIANGLES, 0, data.elem_count_) ;
         }
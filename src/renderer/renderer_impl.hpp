@@ -44,6 +44,9 @@ public:
         GLuint buffers_[10];
         GLuint texture_id_, vao_ ;
         GLuint elem_count_ ;
+
+        // indexed geometry is drawn in tiles, each one a range of the index buffer given as (first index, index count)
+        std::vector<std::pair<GLuint, GLuint>> tiles_ ;
     };
 
     struct FontData {
@@ -65,6 +68,7 @@ public:
 
     void clear(MeshData &data);
     void initBuffersForMesh(MeshData &data, Mesh &mesh) ;
+    void initBuffersForHeightfield(MeshData &data, const HeightfieldGeometry &hf) ;
 
     void render(const Camera &cam, Renderer::RenderMode mode) ;
     void render(const NodePtr &node, const Camera &cam, const Eigen::Matrix4f &mat, Renderer::RenderMode mode) ;
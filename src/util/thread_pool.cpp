@@ -0,0 +1,117 @@
+#include <vsim/util/thread_pool.hpp>
+
+#include <algorithm>
+
+using namespace std ;
+
+namespace vsim { namespace util {
+
+static thread_local size_t g_thread_index = 0 ;
+static thread_local bool g_in_loop = false ; // true while the thread executes tasks of a loop
+
+ThreadPool::ThreadPool(size_t n_threads): next_task_(0) {
+    if ( n_threads == 0 )
+        n_threads = std::max(thread::hardware_concurrency(), 1u) ;
+
+    for( size_t i=1 ; i<n_threads ; i++ )
+        workers_.emplace_back(&ThreadPool::workerLoop, this, i) ;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(mutex_) ;
+        stop_ = true ;
+    }
+
+    start_cond_.notify_all() ;
+
+    for( thread &t: workers_ )
+        t.join() ;
+}
+
+size_t ThreadPool::threadIndex() {
+    return g_thread_index ;
+}
+
+void ThreadPool::run(size_t n, TaskFn fn, void *ctx) {
+
+    if ( n == 0 ) return ;
+
+    if ( workers_.empty() || n == 1 || g_in_loop ) {
+        for( size_t i=0 ; i<n ; i++ )
+            fn(ctx, i) ;
+        return ;
+    }
+
+    lock_guard<mutex> run_lock(run_mutex_) ;
+
+    {
+        lock_guard<mutex> lock(mutex_) ;
+        fn_ = fn ;
+        ctx_ = ctx ;
+        n_tasks_ = n ;
+        next_task_ = 0 ;
+        busy_ = workers_.size() ;
+        error_ = nullptr ;
+        ++generation_ ;
+    }
+
+    start_cond_.notify_all() ;
+
+    g_in_loop = true ;
+    execute() ;
+    g_in_loop = false ;
+
+    exception_ptr error ;
+
+    {
+        unique_lock<mutex> lock(mutex_) ;
+        done_cond_.wait(lock, [this] { return busy_ == 0 ; }) ;
+        error = error_ ;
+    }
+
+    if ( error ) rethrow_exception(error) ;
+}
+
+void ThreadPool::execute() {
+    size_t i ;
+
+    try {
+        while ( ( i = next_task_.fetch_add(1) ) < n_tasks_ )
+            fn_(ctx_, i) ;
+    }
+    catch ( ... ) {
+        // skip remaining tasks
+        next_task_ = n_tasks_ ;
+
+        lock_guard<mutex> lock(mutex_) ;
+        if ( !error_ ) error_ = current_exception() ;
+    }
+}
+
+void ThreadPool::workerLoop(size_t idx) {
+
+    g_thread_index = idx ;
+    g_in_loop = true ;
+
+    unsigned long generation = 0 ;
+
+    while ( true ) {
+        {
+            unique_lock<mutex> lock(mutex_) ;
+            start_cond_.wait(lock, [&] { return stop_ || generation_ != generation ; }) ;
+            if ( stop_ ) return ;
+            generation = generation_ ;
+        }
+
+        execute() ;
+
+        {
+            lock_guard<mutex> lock(mutex_) ;
+            if ( --busy_ == 0 ) done_cond_.notify_one() ;
+        }
+    }
+}
+
+} // namespace util
+} // namespace vsim
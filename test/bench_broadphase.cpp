@@ -0,0 +1,105 @@
+#include <vsim/physics/world.hpp>
+
+#include <btBulletDynamicsCommon.h>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <vector>
+#include <cmath>
+
+using namespace vsim::physics ;
+using namespace std ;
+
+// Compares the broadphase algorithms on clouds of spheres drifting in zero gravity at various counts and densities. The
+// spheres are moved directly and only the broadphase update is timed (AABB update and pair search), there is no
+// narrowphase or solver. Broadphases are created with the same parameters as the world uses for WorldConfig::broadphase_.
+
+static btBroadphaseInterface *make_broadphase(Broadphase broadphase, size_t n_bodies, float extent) {
+    if ( broadphase == Broadphase::DYNAMIC_AABB_TREE )
+        return new btDbvtBroadphase() ;
+
+    btVector3 world_min(-extent, -extent, -extent), world_max(extent, extent, extent) ;
+
+    if ( n_bodies < 16000 )
+        return new btAxisSweep3(world_min, world_max, 16384) ;
+    else
+        return new bt32BitAxisSweep3(world_min, world_max, n_bodies + 1) ;
+}
+
+static double time_per_step(size_t n_bodies, float density, Broadphase broadphase, size_t n_steps) {
+
+    // side of the cube holding n_bodies at the given number of bodies per cubic meter
+    float extent = cbrt(n_bodies/density) ;
+
+    // the world refers to everything declared before it
+    unique_ptr<btBroadphaseInterface> broadphase_interface(make_broadphase(broadphase, n_bodies, extent)) ;
+    btDefaultCollisionConfiguration collision_conf ;
+    btCollisionDispatcher dispatcher(&collision_conf) ;
+    btSphereShape sphere(0.25f) ;
+    vector<unique_ptr<btCollisionObject>> objects ;
+    btAlignedObjectArray<btVector3> velocities ;
+
+    btCollisionWorld world(&dispatcher, broadphase_interface.get(), &collision_conf) ;
+
+    mt19937 rng(1) ;
+    uniform_real_distribution<float> pos(-extent/2, extent/2), vel(-1.f, 1.f) ;
+
+    for( size_t i=0 ; i<n_bodies ; i++ ) {
+        btCollisionObject *obj = new btCollisionObject() ;
+        obj->setCollisionShape(&sphere) ;
+        obj->getWorldTransform().setIdentity() ;
+        obj->getWorldTransform().setOrigin(btVector3(pos(rng), pos(rng), pos(rng))) ;
+
+        objects.emplace_back(obj) ;
+        velocities.push_back(btVector3(vel(rng), vel(rng), vel(rng))) ;
+        world.addCollisionObject(obj) ;
+    }
+
+    // the first update inserts all pairs
+    world.updateAabbs() ;
+    world.computeOverlappingPairs() ;
+
+    const float dt = 1.f/60.f ;
+    double elapsed = 0 ;
+
+    for( size_t s=0 ; s<n_steps ; s++ ) {
+
+        // drift and bounce off the sides of the cube
+        for( size_t i=0 ; i<n_bodies ; i++ ) {
+            btVector3 &p = objects[i]->getWorldTransform().getOrigin() ;
+            btVector3 &v = velocities[i] ;
+            p += v * dt ;
+            for( int k=0 ; k<3 ; k++ )
+                if ( std::fabs(p[k]) > extent/2 ) v[k] = -v[k] ;
+        }
+
+        auto start = chrono::high_resolution_clock::now() ;
+
+        world.updateAabbs() ;
+        world.computeOverlappingPairs() ;
+
+        auto end = chrono::high_resolution_clock::now() ;
+        elapsed += chrono::duration<double, milli>(end - start).count() ;
+    }
+
+    return elapsed/n_steps ;
+}
+
+int main(int argc, char *argv[]) {
+
+    const size_t n_steps = 100 ;
+
+    cout << setw(8) << "bodies" << setw(10) << "density" << setw(12) << "tree (ms)" << setw(12) << "sap (ms)" << setw(10) << "speedup" << endl ;
+
+    for( size_t n_bodies: { 1000, 4000, 16000, 32000 } ) {
+        for( float density: { 0.01f, 0.1f, 1.f } ) {
+            double tree = time_per_step(n_bodies, density, Broadphase::DYNAMIC_AABB_TREE, n_steps) ;
+            double sap = time_per_step(n_bodies, density, Broadphase::SWEEP_AND_PRUNE, n_steps) ;
+
+            cout << setw(8) << n_bodies << setw(10) << density << setw(12) << tree << setw(12) << sap << setw(10) << tree/sap << endl ;
+        }
+    }
+}
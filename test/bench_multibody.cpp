@@ -0,0 +1,125 @@
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/rigid_body_constraint.hpp>
+#include <vsim/env/collision_shape.hpp>
+#include <vsim/env/geometry.hpp>
+#include <vsim/physics/world.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+using namespace vsim ;
+using namespace vsim::physics ;
+using namespace std ;
+using namespace Eigen ;
+
+// compares hinge constraints with reduced coordinate multibodies on horizontal chains swinging under gravity
+
+static RigidBodyPtr make_link(float mass, const Vector3f &pos) {
+    BoxGeometryPtr box(new BoxGeometry) ;
+    box->half_extents_ = Vector3f(0.25f, 0.05f, 0.05f) ;
+
+    CollisionShapePtr shape(new CollisionShape) ;
+    shape->geom_ = box ;
+
+    RigidBodyPtr body(new RigidBody) ;
+    body->shapes_.push_back(shape) ;
+    body->mass_ = mass ;
+    body->pose_.mat_.translate(pos) ;
+
+    return body ;
+}
+
+static PhysicsScenePtr make_chain(size_t n_links) {
+    PhysicsScenePtr scene(new PhysicsScene) ;
+    PhysicsModelPtr chain(new PhysicsModel) ;
+
+    chain->bodies_.push_back(make_link(0.f, Vector3f::Zero())) ;
+
+    for( size_t i=1 ; i<=n_links ; i++ ) {
+        chain->bodies_.push_back(make_link(1.f, Vector3f(i * 0.5f, 0, 0))) ;
+
+        std::shared_ptr<HingeConstraint> hinge(new HingeConstraint) ;
+        hinge->a_ = chain->bodies_[i-1] ;
+        hinge->b_ = chain->bodies_[i] ;
+        hinge->pivot_a_ = Vector3f(0.25f, 0, 0) ;
+        hinge->pivot_b_ = Vector3f(-0.25f, 0, 0) ;
+        chain->constraints_.push_back(hinge) ;
+    }
+
+    scene->models_.push_back(chain) ;
+    return scene ;
+}
+
+int main(int argc, char *argv[]) {
+
+    const size_t n_steps = 500 ;
+
+    cout << setw(8) << "links" << setw(18) << "constraints (ms)" << setw(18) << "multibody (ms)" << setw(18) << "tip drift (m)" << endl ;
+
+    for( size_t n_links: { 5, 10, 20, 50, 100, 200 } ) {
+        double elapsed[2] ;
+        float drift = 0 ;
+
+        for( int mb=0 ; mb<2 ; mb++ ) {
+            PhysicsScenePtr scene = make_chain(n_links) ;
+
+            WorldConfig config ;
+            config.multibody_ = mb ;
+
+            World world(scene, config) ;
+
+            auto start = chrono::high_resolution_clock::now() ;
+
+            for( size_t i=0 ; i<n_steps ; i++ )
+                world.step() ;
+
+            auto end = chrono::high_resolution_clock::now() ;
+            elapsed[mb] = chrono::duration<double, milli>(end - start).count()/n_steps ;
+
+            // separation at the last joint shows how far the constraints drifted
+            if ( !mb ) {
+                const RigidBody *a = world.body(n_links - 1), *b = world.body(n_links) ;
+                Vector3f pa = a->pose_.mat_ * Vector3f(0.25f, 0, 0), pb = b->pose_.mat_ * Vector3f(-0.25f, 0, 0) ;
+                drift = ( pa - pb ).norm() ;
+            }
+        }
+
+        cout << setw(8) << n_links << setw(18) << elapsed[0] << setw(18) << elapsed[1] << setw(18) << drift << endl ;
+    }
+
+    // a short chain held horizontal by joint PD controllers, with frames of 1/30s split in internal steps of 1/240s
+
+    cout << endl << setw(12) << "backend" << setw(18) << "max error (rad)" << endl ;
+
+    for( int mb=0 ; mb<2 ; mb++ ) {
+        PhysicsScenePtr scene = make_chain(5) ;
+
+        WorldConfig config ;
+        config.multibody_ = mb ;
+        config.time_step_ = 1.f/240.f ;
+        config.max_sub_steps_ = 8 ;
+
+        World world(scene, config) ;
+
+        size_t n = world.numJoints() ;
+        vector<float> kp(n, 200.f), kd(n, 5.f), q(n) ;
+        world.setJointGains(kp.data(), kd.data()) ;
+
+        for( size_t i=0 ; i<n_steps ; i++ )
+            world.step(1.f/30.f) ;
+
+        world.getJointPositions(q.data()) ;
+
+        // all links start aligned so the targets are the initial angles (zero) for both backends
+        float max_error = 0 ;
+        for( float qi: q ) max_error = std::max(max_error, std::fabs(qi)) ;
+
+        cout << setw(12) << ( mb ? "multibody" : "constraints" ) << setw(18) << max_error << endl ;
+    }
+}
@@ -0,0 +1,97 @@
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/collision_shape.hpp>
+#include <vsim/env/geometry.hpp>
+#include <vsim/physics/world_batch.hpp>
+#include <vsim/physics/rollout_farm.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+
+using namespace vsim ;
+using namespace vsim::physics ;
+using namespace std ;
+using namespace Eigen ;
+
+// Compares the scaling of rollouts run by threads (WorldBatch) and by forked processes (RolloutFarm) on a pile of boxes
+// dropped on the ground.
+
+static PhysicsScenePtr make_pile(size_t n_boxes) {
+    PhysicsScenePtr scene(new PhysicsScene) ;
+
+    BoxGeometryPtr ground_box(new BoxGeometry) ;
+    ground_box->half_extents_ = Vector3f(20, 0.5f, 20) ;
+
+    CollisionShapePtr ground_shape(new CollisionShape) ;
+    ground_shape->geom_ = ground_box ;
+
+    RigidBodyPtr ground(new RigidBody) ;
+    ground->shapes_.push_back(ground_shape) ;
+    ground->pose_.mat_.translate(Vector3f(0, -0.5f, 0)) ;
+    scene->bodies_.push_back(ground) ;
+
+    BoxGeometryPtr box(new BoxGeometry) ;
+    box->half_extents_ = Vector3f(0.2f, 0.2f, 0.2f) ;
+
+    for( size_t i=0 ; i<n_boxes ; i++ ) {
+        CollisionShapePtr shape(new CollisionShape) ;
+        shape->geom_ = box ;
+
+        RigidBodyPtr body(new RigidBody) ;
+        body->shapes_.push_back(shape) ;
+        body->mass_ = 1.f ;
+        body->pose_.mat_.translate(Vector3f(( i % 5 ) * 0.5f - 1, 0.5f + ( i / 25 ) * 0.5f, ( ( i / 5 ) % 5 ) * 0.5f - 1)) ;
+        scene->bodies_.push_back(body) ;
+    }
+
+    return scene ;
+}
+
+int main(int argc, char *argv[]) {
+
+    const size_t n_rollouts = 64, n_steps = 300, n_boxes = 100 ;
+
+    PhysicsScenePtr scene = make_pile(n_boxes) ;
+
+    // push the first box sideways, the reward is its height
+    RolloutFarm::Policy policy = [](size_t, size_t, const float *state, float *actions) {
+        actions[WorldBatch::ACTION_SIZE] = 5.f ;
+        return state[WorldBatch::STATE_SIZE + 1] ;
+    } ;
+
+    size_t max_workers = std::max<size_t>(thread::hardware_concurrency(), 1) ;
+
+    cout << setw(8) << "workers" << setw(16) << "threads (s)" << setw(18) << "processes (s)" << setw(10) << "speedup" << endl ;
+
+    double single_process = 0 ;
+
+    for( size_t n_workers = 1 ; n_workers <= max_workers ; n_workers *= 2 ) {
+
+        auto start = chrono::high_resolution_clock::now() ;
+
+        {
+            WorldBatch batch(scene, n_rollouts, WorldConfig(), n_workers) ;
+            vector<float> actions(n_rollouts * batch.numBodies() * WorldBatch::ACTION_SIZE, 0.f) ;
+            for( size_t i=0 ; i<n_rollouts ; i++ )
+                actions[( i * batch.numBodies() + 1 ) * WorldBatch::ACTION_SIZE] = 5.f ;
+
+            for( size_t s=0 ; s<n_steps ; s++ )
+                batch.step(actions.data(), nullptr) ;
+        }
+
+        auto mid = chrono::high_resolution_clock::now() ;
+
+        RolloutFarm farm(scene, WorldConfig(), n_workers) ;
+        farm.run(n_rollouts, n_steps, policy) ;
+
+        auto end = chrono::high_resolution_clock::now() ;
+
+        double threads = chrono::duration<double>(mid - start).count() ;
+        double processes = chrono::duration<double>(end - mid).count() ;
+        if ( n_workers == 1 ) single_process = processes ;
+
+        cout << setw(8) << n_workers << setw(16) << threads << setw(18) << processes << setw(10) << single_process/processes << endl ;
+    }
+}
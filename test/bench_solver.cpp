@@ -0,0 +1,87 @@
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/collision_shape.hpp>
+#include <vsim/env/geometry.hpp>
+#include <vsim/physics/world.hpp>
+#include <vsim/util/thread_pool.hpp>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+
+using namespace vsim ;
+using namespace vsim::physics ;
+using namespace std ;
+using namespace Eigen ;
+
+// compares the sequential and the multithreaded solver on scenes with towers of stacked boxes
+
+static RigidBodyPtr make_box(float hs, float mass, const Vector3f &pos) {
+    BoxGeometryPtr box(new BoxGeometry) ;
+    box->half_extents_ = Vector3f(hs, hs, hs) ;
+
+    CollisionShapePtr shape(new CollisionShape) ;
+    shape->geom_ = box ;
+
+    RigidBodyPtr body(new RigidBody) ;
+    body->shapes_.push_back(shape) ;
+    body->mass_ = mass ;
+    body->pose_.mat_.translate(pos) ;
+
+    return body ;
+}
+
+static PhysicsScenePtr make_stacks(size_t n_bodies, size_t tower_height) {
+    PhysicsScenePtr scene(new PhysicsScene) ;
+
+    size_t n_towers = ( n_bodies + tower_height - 1 )/tower_height ;
+    size_t side = ceil(sqrt(n_towers)) ;
+
+    scene->bodies_.push_back(make_box(side * 2.f + 10.f, 0.f, Vector3f(0, -side * 2.f - 10.f, 0))) ;
+
+    for( size_t i=0 ; i<n_bodies ; i++ ) {
+        size_t tower = i / tower_height, level = i % tower_height ;
+        float x = ( tower % side ) * 2.f - side, z = ( tower / side ) * 2.f - side ;
+        scene->bodies_.push_back(make_box(0.5f, 1.f, Vector3f(x, 0.5f + level * 1.01f, z))) ;
+    }
+
+    return scene ;
+}
+
+static double time_per_step(const PhysicsScenePtr &scene, bool mt, size_t n_steps) {
+    WorldConfig config ;
+    config.multithreaded_ = mt ;
+
+    World world(scene, config) ;
+
+    // let the stacks settle before timing
+    for( size_t i=0 ; i<30 ; i++ )
+        world.step() ;
+
+    auto start = chrono::high_resolution_clock::now() ;
+
+    for( size_t i=0 ; i<n_steps ; i++ )
+        world.step() ;
+
+    auto end = chrono::high_resolution_clock::now() ;
+
+    return chrono::duration<double, milli>(end - start).count()/n_steps ;
+}
+
+int main(int argc, char *argv[]) {
+
+    const size_t n_steps = 200 ;
+
+    cout << "threads: " << util::ThreadPool::instance().numThreads() << endl ;
+    cout << setw(8) << "bodies" << setw(16) << "sequential (ms)" << setw(16) << "parallel (ms)" << setw(10) << "speedup" << endl ;
+
+    for( size_t n_bodies: { 10, 50, 100, 250, 500, 1000, 2000, 4000 } ) {
+        PhysicsScenePtr scene = make_stacks(n_bodies, 10) ;
+
+        double st = time_per_step(scene, false, n_steps) ;
+        double mt = time_per_step(scene, true, n_steps) ;
+
+        cout << setw(8) << n_bodies << setw(16) << st << setw(16) << mt << setw(10) << st/mt << endl ;
+    }
+}
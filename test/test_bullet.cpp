@@ -1,20 +1,25 @@
 #include <btBulletDynamicsCommon.h>
 
+#include <vsim/physics/pose_interpolation.hpp>
+
 #include <GL/glew.h>
 #include "glfw_window.hpp"
 
 #include <memory>
 #include <vector>
 #include <iostream>
+#include <chrono>
+#include <cstdlib>
 
 using namespace std ;
+using namespace vsim::physics ;
 
 struct BulletBody {
     std::unique_ptr<btDefaultMotionState> motion_state_ ;
     std::unique_ptr<btCollisionShape> shape_ ;
     std::unique_ptr<btRigidBody> body_ ;
 
-    virtual void render() = 0 ;
+    virtual void render(const btTransform &trans) = 0 ;
 
     void setId(const std::string &id) {
         id_ = id ;
@@ -36,7 +41,19 @@ struct PhysicsWorld {
       dynamics_world_->stepSimulation(seconds, 1, seconds) ;
   }
 
-  void render() {
+  // poses of all bodies after the last step, one array per component as expected by interpolatePoses
+  void getPoses(float *poses) const {
+      size_t n = bodies_.size() ;
+      for( size_t i=0 ; i<n ; i++ ) {
+          const btTransform &tr = bodies_[i]->body_->getWorldTransform() ;
+          btQuaternion q = tr.getRotation() ;
+          const btVector3 &p = tr.getOrigin() ;
+          poses[i] = p.x() ; poses[n + i] = p.y() ; poses[2*n + i] = p.z() ;
+          poses[3*n + i] = q.x() ; poses[4*n + i] = q.y() ; poses[5*n + i] = q.z() ; poses[6*n + i] = q.w() ;
+      }
+  }
+
+  void render(const float *poses) {
 
       glClear(GL_COLOR_BUFFER_BIT);
 
@@ -44,8 +61,10 @@ struct PhysicsWorld {
       glMatrixMode(GL_MODELVIEW);
       glLoadIdentity();
 ;
-      for( auto &b: bodies_) {
-          b->render() ;
+      size_t n = bodies_.size() ;
+      for( size_t i=0 ; i<n ; i++ ) {
+          const float *p = poses + i ;
+          bodies_[i]->render(btTransform(btQuaternion(p[3*n], p[4*n], p[5*n], p[6*n]), btVector3(p[0], p[n], p[2*n]))) ;
       }
 
       glFlush() ;
@@ -84,10 +103,7 @@ struct BoxBody: public BulletBody {
         body_->setDamping(0, 0);
       }
 
-    void render() {
-        btTransform trans;
-        body_->getMotionState()->getWorldTransform(trans);
-
+    void render(const btTransform &trans) override {
         float w = sz_.x(), h = sz_.y() ;
         float x = trans.getOrigin().getX(), y = trans.getOrigin().getY() ;
         float angle = trans.getRotation().getAngle() ;
@@ -129,7 +145,7 @@ struct GroundPlane: public BulletBody {
         body_->setFriction(0.7f);
     }
 
-    void render() override {
+    void render(const btTransform &) override {
         glColor3ub( 0, 0, 255 );
         glBegin(GL_LINE);
             glVertex2f( 0.0, 100.0);
@@ -167,7 +183,14 @@ struct HingeConstraint {
 class glfwGUI: public glfwRenderWindow {
 public:
 
-    glfwGUI(PhysicsWorld &world): glfwRenderWindow(), world_(world) {
+    glfwGUI(PhysicsWorld &world, float time_step): glfwRenderWindow(), world_(world), stepper_(time_step) {
+        size_t n = world_.bodies_.size() * POSE_SIZE ;
+        prev_poses_.resize(n) ;
+        curr_poses_.resize(n) ;
+        poses_.resize(n) ;
+
+        world_.getPoses(curr_poses_.data()) ;
+        prev_poses_ = curr_poses_ ;
     }
 
     void onInit() {
@@ -235,14 +258,30 @@ public:
     }
 
 
+    // Physics runs at its own fixed rate independently of the display rate. The frame time is accumulated and consumed in
+    // physics steps, the leftover fraction of a step interpolates between the last two physics states.
+
     void onRender() {
-        // Clear the screen
+        auto now = chrono::steady_clock::now() ;
+        float frame_time = started_ ? chrono::duration<float>(now - last_frame_).count() : 0.f ;
+        last_frame_ = now ;
+        started_ = true ;
+
+        for( size_t n = stepper_.advance(frame_time) ; n > 0 ; n-- ) {
+            prev_poses_.swap(curr_poses_) ;
+            world_.step(stepper_.timeStep()) ;
+            world_.getPoses(curr_poses_.data()) ;
+        }
 
-        world_.render() ;
-        world_.step(0.05) ;
+        interpolatePoses(world_.bodies_.size(), prev_poses_.data(), curr_poses_.data(), stepper_.alpha(), poses_.data()) ;
+        world_.render(poses_.data()) ;
     }
 
    PhysicsWorld &world_ ;
+   StepAccumulator stepper_ ;
+   std::vector<float> prev_poses_, curr_poses_, poses_ ;
+   chrono::steady_clock::time_point last_frame_ ;
+   bool started_ = false ;
 };
 
 
@@ -263,7 +302,10 @@ int main(int argc, char *argv[]) {
 
 
 
-    glfwGUI gui(world) ;
+    // physics rate in Hz, the display rate is set by the monitor refresh
+    float physics_rate = argc > 1 ? atof(argv[1]) : 240.f ;
+
+    glfwGUI gui(world, 1.f/physics_rate) ;
     gui.run(500, 500, "gui") ;
 
 }
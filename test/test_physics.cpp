@@ -0,0 +1,320 @@
+#include <vsim/env/scene.hpp>
+#include <vsim/env/physics_scene.hpp>
+#include <vsim/env/rigid_body.hpp>
+#include <vsim/env/physics_model.hpp>
+#include <vsim/physics/world.hpp>
+#include <vsim/physics/world_batch.hpp>
+#include <vsim/physics/trajectory.hpp>
+#include <vsim/physics/collision_checker.hpp>
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+using namespace vsim ;
+using namespace vsim::physics ;
+using namespace std ;
+
+static const char *scene_src = R"(
+    return Scene {
+        PhysicsScene {
+            RigidBody {
+                CollisionShape { Box { 10, 0.5, 10 } }
+            },
+            RigidBody {
+                mass = 1.0,
+                Pose { translate { 0, 2, 0 } },
+                CollisionShape { Box { 0.5, 0.5, 0.5 } }
+            },
+            RigidBody {
+                mass = 2.0,
+                Pose { translate { 0.2, 4, 0 }, rotate { 0, 0, 1, 30 } },
+                CollisionShape { Box { 0.5, 0.5, 0.5 } }
+            }
+        }
+    }
+)" ;
+
+// a thin wall and a small fast box, ccd_threshold = 0 disables continuous collision detection for the second box
+static const char *tunneling_src = R"(
+    return Scene {
+        PhysicsScene {
+            RigidBody {
+                CollisionShape { Box { 0.01, 2, 2 } }
+            },
+            RigidBody {
+                mass = 0.1,
+                Pose { translate { -2, 0, -1 } },
+                CollisionShape { Box { 0.05, 0.05, 0.05 } }
+            },
+            RigidBody {
+                mass = 0.1,
+                ccd_threshold = 0,
+                Pose { translate { -2, 0, 1 } },
+                CollisionShape { Box { 0.05, 0.05, 0.05 } }
+            }
+        }
+    }
+)" ;
+
+int main(int argc, char *argv[]) {
+
+    ScenePtr scene = Scene::loadFromString(scene_src) ;
+
+    World world(scene->physics_scene_) ;
+
+    const size_t n_steps = 10000 ;
+
+    auto start = chrono::high_resolution_clock::now() ;
+
+    for( size_t i=0 ; i<n_steps ; i++ )
+        world.step() ;
+
+    auto end = chrono::high_resolution_clock::now() ;
+    double elapsed = chrono::duration<double>(end - start).count() ;
+
+    for( size_t i=0 ; i<world.numBodies() ; i++ ) {
+        const RigidBody *b = world.body(i) ;
+        cout << i << ": " << b->pose_.mat_.translation().adjoint() << endl ;
+    }
+
+    cout << n_steps/elapsed << " steps/s" << endl ;
+    cout << world.activeBodies().size() << " bodies active after settling" << endl ;
+    cout << world.numCollisionShapes() << " collision shapes, " << world.numSharedCollisionShapes() << " shared" << endl ;
+
+    // adaptive substepping of the same scene dropped again, at 30 frames per second with a 5ms budget per frame
+
+    {
+        ScenePtr drop = Scene::loadFromString(scene_src) ;
+
+        WorldConfig config ;
+        config.adaptive_stepping_.enabled_ = true ;
+        config.adaptive_stepping_.budget_ = 0.005f ;
+
+        World adaptive(drop->physics_scene_, config) ;
+
+        size_t total_sub_steps = 0 ;
+        for( size_t i=0 ; i<300 ; i++ ) {
+            adaptive.step(1.f/30.f) ;
+            total_sub_steps += adaptive.numSubSteps() ;
+        }
+
+        cout << "adaptive stepping: " << total_sub_steps/300.f << " substeps per frame, final substep " << adaptive.subStepSize() << "s" << endl ;
+    }
+
+    // boxes shot at 200 m/s towards the wall, only the one with continuous collision detection should be stopped
+
+    {
+        ScenePtr shoot = Scene::loadFromString(tunneling_src) ;
+
+        WorldConfig config ;
+        config.gravity_ = Eigen::Vector3f::Zero() ;
+
+        for( size_t i=1 ; i<3 ; i++ )
+            shoot->physics_scene_->bodies_[i]->velocity_ = Eigen::Vector3f(200.f, 0, 0) ;
+
+        World tunneling(shoot->physics_scene_, config) ;
+
+        for( size_t i=0 ; i<30 ; i++ )
+            tunneling.step() ;
+
+        bool ccd_passed = tunneling.body(1)->pose_.mat_.translation().x() > 0 ;
+
+        cout << "tunneling with ccd: " << ( ccd_passed ? "yes" : "no" )
+             << ", without: " << ( tunneling.body(2)->pose_.mat_.translation().x() > 0 ? "yes" : "no" ) << endl ;
+
+        if ( ccd_passed ) {
+            cerr << "box with continuous collision detection passed the wall" << endl ;
+            return 1 ;
+        }
+    }
+
+    // same shot with the box filtered out of the wall group, it should pass through despite continuous collision detection
+
+    {
+        ScenePtr shoot = Scene::loadFromString(tunneling_src) ;
+
+        WorldConfig config ;
+        config.gravity_ = Eigen::Vector3f::Zero() ;
+
+        shoot->physics_scene_->bodies_[0]->collision_group_ = 4 ;
+        shoot->physics_scene_->bodies_[1]->collision_mask_ = ~4 ;
+        shoot->physics_scene_->bodies_[1]->velocity_ = Eigen::Vector3f(200.f, 0, 0) ;
+
+        World filtered(shoot->physics_scene_, config) ;
+
+        for( size_t i=0 ; i<30 ; i++ )
+            filtered.step() ;
+
+        bool filtered_passed = filtered.body(1)->pose_.mat_.translation().x() > 0 ;
+
+        cout << "filtered box passed the wall: " << ( filtered_passed ? "yes" : "no" ) << endl ;
+
+        if ( !filtered_passed ) {
+            cerr << "box filtered out of the wall group was stopped by the wall" << endl ;
+            return 1 ;
+        }
+    }
+
+    // branch the simulation from a snapshot and check that replaying gives the same result
+
+    World::SnapshotHandle snap = world.snapshot() ;
+
+    for( size_t i=0 ; i<100 ; i++ ) world.step() ;
+    Eigen::Matrix4f first = world.body(1)->pose_.mat_.matrix() ;
+
+    world.restore(snap) ;
+
+    for( size_t i=0 ; i<100 ; i++ ) world.step() ;
+    Eigen::Matrix4f second = world.body(1)->pose_.mat_.matrix() ;
+
+    float replay_difference = ( first - second ).norm() ;
+    cout << "snapshot replay difference: " << replay_difference << endl ;
+
+    if ( replay_difference > 1.0e-5f ) {
+        cerr << "replay from snapshot diverged" << endl ;
+        return 1 ;
+    }
+
+    world.releaseSnapshot(snap) ;
+
+    // upward impulse on all bodies through the bulk interface, static bodies are left alone
+
+    {
+        size_t n = world.numBodies() ;
+        vector<float> impulses(3 * n, 0.f), before(3 * n), after(3 * n) ;
+
+        for( size_t i=0 ; i<n ; i++ )
+            impulses[3 * i + 1] = world.body(i)->mass_ ;
+
+        world.getStates(nullptr, nullptr, before.data(), nullptr) ;
+        world.applyImpulses(impulses.data()) ;
+        world.getStates(nullptr, nullptr, after.data(), nullptr) ;
+
+        float max_dv = 0 ;
+        for( size_t i=0 ; i<n ; i++ )
+            max_dv = std::max(max_dv, after[3 * i + 1] - before[3 * i + 1]) ;
+
+        cout << "bulk impulse velocity change: " << max_dv << " (expected 1)" << endl ;
+
+        if ( std::fabs(max_dv - 1.f) > 1.0e-4f ) {
+            cerr << "bulk impulse gave the wrong velocity change" << endl ;
+            return 1 ;
+        }
+    }
+
+    // contact transitions of the falling boxes
+
+    ContactFilter filter ;
+    filter.transitions_only_ = true ;
+    ContactStream &contacts = world.enableContactEvents(filter) ;
+
+    for( size_t i=0 ; i<1000 ; i++ ) world.step() ;
+
+    ContactEvent event ;
+    while ( contacts.pop(event) )
+        cout << ( event.type_ == ContactEvent::BEGIN ? "begin " : "end " ) << event.body_a_ << "-" << event.body_b_ << " at " << event.time_ << endl ;
+
+    world.disableContactEvents() ;
+
+    // per phase timings of the settled scene
+
+    {
+        StepProfiler &profiler = world.enableProfiling() ;
+
+        for( size_t i=0 ; i<100 ; i++ ) world.step() ;
+
+        StepProfile avg = profiler.average() ;
+        cout << "profile (ms): total " << avg.total_ * 1000 << ", broadphase " << avg.broadphase_ * 1000 << ", narrowphase "
+             << avg.narrowphase_ * 1000 << ", solver " << avg.solver_ * 1000 << ", integration " << avg.integration_ * 1000
+             << ", " << avg.n_manifolds_ << " manifolds" << endl ;
+
+        profiler.writeCSV("/tmp/test_physics_profile.csv") ;
+        world.disableProfiling() ;
+    }
+
+    // record a trajectory and read back the last pose
+
+    {
+        TrajectoryRecorder recorder("/tmp/test_physics.trj", scene->physics_scene_) ;
+
+        for( size_t i=0 ; i<1000 ; i++ ) {
+            world.step() ;
+            recorder.record(world.time()) ;
+        }
+    }
+
+    TrajectoryReader reader("/tmp/test_physics.trj") ;
+
+    cout << "trajectory: " << reader.numSteps() << " steps, last pose error: "
+         << ( reader.position(reader.numSteps() - 1, 1) - world.body(1)->pose_.mat_.translation() ).norm() << endl ;
+
+    // downward rays on a regular grid over the ground
+
+    const size_t n_rays = 100000, side = 316 ;
+    vector<float> origins(3 * n_rays), directions(3 * n_rays, 0.f), distances(n_rays) ;
+    vector<int> hit_bodies(n_rays) ;
+
+    for( size_t i=0 ; i<n_rays ; i++ ) {
+        origins[i] = -5.f + 10.f * ( i % side )/side ;
+        origins[n_rays + i] = 10.f ;
+        origins[2 * n_rays + i] = -5.f + 10.f * ( i / side )/side ;
+        directions[n_rays + i] = -1.f ;
+    }
+
+    start = chrono::high_resolution_clock::now() ;
+    world.rayCastBatch(n_rays, origins.data(), directions.data(), 20.f, distances.data(), nullptr, hit_bodies.data()) ;
+    end = chrono::high_resolution_clock::now() ;
+
+    size_t n_hits = count_if(hit_bodies.begin(), hit_bodies.end(), [](int b) { return b >= 0 ; }) ;
+    cout << n_hits << "/" << n_rays << " rays hit, " << n_rays/chrono::duration<double>(end - start).count() << " rays/s" << endl ;
+
+    // collision checking of a free box at random poses above the ground
+
+    PhysicsScenePtr planning_scene = make_shared<PhysicsScene>() ;
+    PhysicsModelPtr free_box = make_shared<PhysicsModel>() ;
+    free_box->bodies_.push_back(scene->physics_scene_->bodies_[1]) ;
+    planning_scene->bodies_.push_back(scene->physics_scene_->bodies_[0]) ;
+    planning_scene->models_.push_back(free_box) ;
+
+    CollisionChecker checker(planning_scene, free_box) ;
+
+    const size_t n_configs = 100000 ;
+    vector<float> poses(n_configs * CollisionChecker::POSE_SIZE), clearance(n_configs) ;
+    vector<uint8_t> in_collision(n_configs) ;
+
+    for( size_t i=0 ; i<n_configs ; i++ ) {
+        Eigen::Quaternionf q = Eigen::Quaternionf::UnitRandom() ;
+        float *pose = &poses[i * CollisionChecker::POSE_SIZE] ;
+        pose[0] = 0 ; pose[1] = 3.f * i/n_configs ; pose[2] = 0 ;
+        pose[3] = q.x() ; pose[4] = q.y() ; pose[5] = q.z() ; pose[6] = q.w() ;
+    }
+
+    start = chrono::high_resolution_clock::now() ;
+    checker.check(n_configs, poses.data(), in_collision.data(), clearance.data()) ;
+    end = chrono::high_resolution_clock::now() ;
+
+    size_t n_collisions = count(in_collision.begin(), in_collision.end(), 1) ;
+    cout << n_collisions << "/" << n_configs << " configurations in collision, " << n_configs/chrono::duration<double>(end - start).count() << " checks/s" << endl ;
+
+    // replicas of the same scene stepped in parallel
+
+    const size_t n_worlds = 64, n_batch_steps = 1000 ;
+
+    WorldBatch batch(scene->physics_scene_, n_worlds) ;
+
+    vector<float> actions(n_worlds * batch.numBodies() * WorldBatch::ACTION_SIZE, 0.f) ;
+    vector<float> states(n_worlds * batch.numBodies() * WorldBatch::STATE_SIZE) ;
+
+    start = chrono::high_resolution_clock::now() ;
+
+    for( size_t i=0 ; i<n_batch_steps ; i++ )
+        batch.step(actions.data(), states.data()) ;
+
+    end = chrono::high_resolution_clock::now() ;
+    elapsed = chrono::duration<double>(end - start).count() ;
+
+    cout << n_worlds * n_batch_steps/elapsed << " environment steps/s" << endl ;
+}